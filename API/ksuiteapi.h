@@ -225,16 +225,31 @@ namespace KAPI {
         }
     };
 #ifdef BUILD_SHAREDCACHE
+    struct ObjCClassLocation {
+        std::string installName;
+        uint64_t address;
+    };
+
     class SharedCache {
         Ref<BinaryView> m_view;
     public:
         SharedCache(Ref<BinaryView> view);
 
         bool LoadImageWithInstallName(std::string installName);
+        size_t LoadImages(const std::vector<std::string>& installNames, size_t dependencyDepth = 0);
         bool LoadSectionAtAddress(uint64_t addr);
         std::vector<std::string> GetAvailableImages();
 
         uint64_t LoadedImageCount();
+
+        // Resolved through the cache's prebuilt ObjC tables; no image needs to be loaded. 0/empty if not found.
+        uint64_t GetObjCSelectorAddress(const std::string& name);
+        std::vector<ObjCClassLocation> GetObjCClassLocations(const std::string& name);
+
+        // Resolved through the cache-wide symbol index. `name` may be qualified, as "libfoo.dylib!_bar". 0 if not found.
+        uint64_t GetSymbolAddress(const std::string& name);
+        // "libfoo.dylib!_bar+0x14" for any address inside an image, loaded or not; empty if it isn't in one.
+        std::string SymbolizeAddress(uint64_t address);
     };
 #endif
 }
\ No newline at end of file
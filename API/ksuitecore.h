@@ -41,7 +41,20 @@ struct BNKCacheImage {
 char** KSUITE_FFI_API BNDSCViewGetInstallNames(BNBinaryView *view, size_t* count);
 bool KSUITE_FFI_API BNDSCViewLoadImageWithInstallName(BNBinaryView* view, char* name);
 bool KSUITE_FFI_API BNDSCViewLoadSectionAtAddress(BNBinaryView* view, uint64_t name);
+uint64_t KSUITE_FFI_API BNDSCViewLoadImages(BNBinaryView* view, char** names, size_t count, size_t dependencyDepth);
 uint64_t KSUITE_FFI_API BNDSCViewLoadedImageCount(BNBinaryView *view);
+
+struct BNDSCObjCClassLocation {
+    char* imageName;
+    uint64_t address;
+};
+
+uint64_t KSUITE_FFI_API BNDSCViewGetObjCSelectorAddress(BNBinaryView* view, char* name);
+BNDSCObjCClassLocation* KSUITE_FFI_API BNDSCViewGetObjCClassLocations(BNBinaryView* view, char* name, size_t* count);
+void KSUITE_FFI_API BNDSCFreeObjCClassLocations(BNDSCObjCClassLocation* locations, size_t count);
+
+uint64_t KSUITE_FFI_API BNDSCViewGetSymbolAddress(BNBinaryView* view, char* name);
+char* KSUITE_FFI_API BNDSCViewSymbolizeAddress(BNBinaryView* view, uint64_t address);
 #endif
 };
 
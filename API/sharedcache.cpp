@@ -20,6 +20,16 @@ namespace KAPI {
         char* str = BNAllocString(installName.c_str());
         return BNDSCViewLoadImageWithInstallName(m_view->m_object, str);
     }
+    size_t SharedCache::LoadImages(const std::vector<std::string>& installNames, size_t dependencyDepth)
+    {
+        if (!m_view->GetParentView())
+            return 0;
+        std::vector<const char*> cstrings;
+        for (const auto& name : installNames)
+            cstrings.push_back(name.c_str());
+        char** names = BNAllocStringList(cstrings.data(), cstrings.size());
+        return BNDSCViewLoadImages(m_view->m_object, names, cstrings.size(), dependencyDepth);
+    }
     bool SharedCache::LoadSectionAtAddress(uint64_t addr)
     {
         if (!m_view->GetParentView())
@@ -52,5 +62,47 @@ namespace KAPI {
             return {};
         return BNDSCViewLoadedImageCount(m_view->m_object);
     }
+    uint64_t SharedCache::GetObjCSelectorAddress(const std::string& name)
+    {
+        if (!m_view->GetParentView())
+            return 0;
+        char* str = BNAllocString(name.c_str());
+        return BNDSCViewGetObjCSelectorAddress(m_view->m_object, str);
+    }
+    std::vector<ObjCClassLocation> SharedCache::GetObjCClassLocations(const std::string& name)
+    {
+        if (!m_view->GetParentView())
+            return {};
+        char* str = BNAllocString(name.c_str());
+        size_t count;
+        BNDSCObjCClassLocation* value = BNDSCViewGetObjCClassLocations(m_view->m_object, str, &count);
+        if (value == nullptr)
+            return {};
+
+        std::vector<ObjCClassLocation> result;
+        for (size_t i = 0; i < count; i++)
+            result.push_back({value[i].imageName, value[i].address});
+
+        BNDSCFreeObjCClassLocations(value, count);
+        return result;
+    }
+    uint64_t SharedCache::GetSymbolAddress(const std::string& name)
+    {
+        if (!m_view->GetParentView())
+            return 0;
+        char* str = BNAllocString(name.c_str());
+        return BNDSCViewGetSymbolAddress(m_view->m_object, str);
+    }
+    std::string SharedCache::SymbolizeAddress(uint64_t address)
+    {
+        if (!m_view->GetParentView())
+            return {};
+        char* value = BNDSCViewSymbolizeAddress(m_view->m_object, address);
+        if (value == nullptr)
+            return {};
+        std::string result = value;
+        BNFreeString(value);
+        return result;
+    }
 };
 #endif
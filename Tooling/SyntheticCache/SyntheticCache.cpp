@@ -0,0 +1,1076 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include "SyntheticCache.h"
+#include "CacheHeader.h"
+#include "MachO.h"
+
+
+static constexpr uint64_t CacheBaseAddress = 0x180000000;
+static constexpr uint64_t CachePageSize = 0x4000;
+static constexpr uint64_t SegmentAlignment = 0x1000;
+
+static constexpr uint32_t VMProtRead = 1;
+static constexpr uint32_t VMProtWrite = 2;
+static constexpr uint32_t VMProtExecute = 4;
+
+static constexpr uint32_t LoadCommandSymtab = 0x2;
+static constexpr uint32_t LoadCommandLoadDylib = 0xc;
+static constexpr uint32_t LoadCommandIdDylib = 0xd;
+static constexpr uint32_t Arm64Ret = 0xd65f03c0;
+
+static constexpr uint32_t ClassROMeta = 1;
+static constexpr uint32_t RelativeMethodListFlag = 0x80000000;
+static constexpr uint32_t RelativeMethodSize = 12;
+static constexpr const char* MethodTypes = "v16@0:8";
+
+// Sizes of the ObjC structures we lay out; these match DSCObjC's.
+static constexpr uint64_t ClassSize = 40;
+static constexpr uint64_t ClassROSize = 72;
+
+
+namespace {
+    struct DylibCommand {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t nameOffset;
+        uint32_t timestamp;
+        uint32_t currentVersion;
+        uint32_t compatibilityVersion;
+    };
+
+    struct UUIDCommand {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint8_t uuid[16];
+    };
+
+    struct SymtabCommand {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t symoff;
+        uint32_t nsyms;
+        uint32_t stroff;
+        uint32_t strsize;
+    };
+
+    struct Mapping {
+        uint64_t address = 0;
+        uint64_t fileOffset = 0;
+        uint64_t size = 0;
+    };
+
+    struct ImagePlan {
+        uint32_t index;
+        std::string installName;
+        uint8_t uuid[16];
+
+        // __TEXT
+        uint64_t textSegmentAddress;
+        uint64_t textSegmentOffset;
+        uint64_t textSegmentSize;
+        uint64_t loadCommandsSize;
+        uint64_t codeAddress;
+        uint64_t codeSize;
+        uint64_t methodTypesAddress;
+        uint64_t methodNamesAddress;
+        uint64_t methodNamesSize;
+        uint64_t classNamesAddress;
+        uint64_t classNamesSize;
+        std::vector<uint32_t> methodNameOffsets;
+        std::vector<uint32_t> classNameOffsets;
+
+        // __DATA, only if the image has classes
+        uint64_t dataSegmentAddress = 0;
+        uint64_t dataSegmentOffset = 0;
+        uint64_t dataSegmentSize = 0;
+        uint64_t classListAddress = 0;
+        uint64_t selectorRefsAddress = 0;
+        uint64_t constAddress = 0;
+        uint64_t constSize = 0;
+        uint64_t classesAddress = 0;
+        uint64_t classesSize = 0;
+
+        // Export trie, in the file's __LINKEDIT
+        std::vector<uint8_t> exportTrie;
+        uint64_t exportTrieOffset = 0;
+    };
+
+    struct FilePlan {
+        std::string path;
+        uint8_t uuid[16];
+        uint32_t firstImage;
+        uint32_t imageCount;
+        uint64_t headerSize;
+        Mapping text;
+        Mapping data;
+        Mapping linkedit;
+
+        // Everything except __TEXT is small enough to build in memory.
+        std::vector<uint8_t> dataBytes;
+        std::vector<std::pair<uint64_t, uint64_t>> rebases; // (offset in __DATA, target address)
+        std::vector<uint8_t> linkeditBytes;
+        std::vector<uint8_t> slideInfo;
+        uint64_t slideInfoOffset = 0;
+        uint64_t end = 0;
+    };
+
+
+    // Sequential writer with enough bookkeeping to pad to a given file offset.
+    class FileWriter {
+        std::string m_path;
+        FILE* m_file;
+        uint64_t m_offset = 0;
+
+    public:
+        explicit FileWriter(const std::string& path) : m_path(path)
+        {
+            m_file = fopen(path.c_str(), "wb");
+            if (!m_file)
+                throw SyntheticCacheException("Couldn't create " + path);
+        }
+
+        ~FileWriter()
+        {
+            if (m_file)
+                fclose(m_file);
+        }
+
+        uint64_t Offset() const { return m_offset; };
+
+        void Write(const void* data, size_t length)
+        {
+            if (length && fwrite(data, 1, length, m_file) != length)
+                throw SyntheticCacheException("Couldn't write to " + m_path);
+            m_offset += length;
+        }
+
+        void PadTo(uint64_t offset)
+        {
+            static const uint8_t zeroes[0x1000] = {};
+            if (offset < m_offset)
+                throw SyntheticCacheException("Overlapping contents in " + m_path);
+            while (m_offset < offset)
+                Write(zeroes, std::min<uint64_t>(sizeof(zeroes), offset - m_offset));
+        }
+
+        void Close()
+        {
+            bool ok = fclose(m_file) == 0;
+            m_file = nullptr;
+            if (!ok)
+                throw SyntheticCacheException("Couldn't write to " + m_path);
+        }
+    };
+}
+
+
+static uint64_t Align(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+
+template <typename T>
+static void Put(std::vector<uint8_t>& out, uint64_t offset, const T& value)
+{
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+
+template <typename T>
+static void Append(std::vector<uint8_t>& out, const T& value)
+{
+    auto bytes = (const uint8_t*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+
+static void AppendULEB128(std::vector<uint8_t>& out, uint64_t value)
+{
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value)
+            byte |= 0x80;
+        out.push_back(byte);
+    } while (value);
+}
+
+
+static size_t ULEB128Size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >>= 7)
+        size++;
+    return size;
+}
+
+
+static void MakeUUID(uint8_t uuid[16], uint32_t seed, uint32_t kind, uint32_t index)
+{
+    // FNV-1a, twice over, so each file and image gets a distinct but reproducible UUID.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (uint32_t value : {seed, kind, index})
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3;
+        }
+    }
+    uint64_t second = hash * 0x100000001b3 ^ 0x5bd1e995;
+    memcpy(uuid, &hash, 8);
+    memcpy(uuid + 8, &second, 8);
+}
+
+
+/*
+ * Serializes an export trie over (name, offset from the image header) pairs.
+ *
+ * Nodes split at the first character where their names differ, so no node has more than 128 children. Child offsets
+ *  are ULEB128 encoded, so node offsets are recomputed until they stop changing size.
+ */
+static std::vector<uint8_t> BuildExportTrie(std::vector<std::pair<std::string, uint64_t>> exports)
+{
+    struct Node {
+        bool terminal = false;
+        uint64_t address = 0;
+        std::vector<std::pair<std::string, size_t>> children;
+        uint64_t offset = 0;
+    };
+
+    std::vector<Node> nodes;
+    if (exports.empty())
+        return {};
+    std::sort(exports.begin(), exports.end());
+    exports.erase(std::unique(exports.begin(), exports.end(),
+                              [](const auto& a, const auto& b) { return a.first == b.first; }), exports.end());
+
+    struct Pending {
+        size_t node;
+        size_t prefixLength;
+        size_t begin;
+        size_t end;
+    };
+    nodes.emplace_back();
+    std::vector<Pending> pending = {{0, 0, 0, exports.size()}};
+    while (!pending.empty())
+    {
+        auto [node, prefixLength, begin, end] = pending.back();
+        pending.pop_back();
+
+        // Sorted, so a name ending exactly here comes first.
+        if (exports[begin].first.size() == prefixLength)
+        {
+            nodes[node].terminal = true;
+            nodes[node].address = exports[begin].second;
+            begin++;
+        }
+        while (begin < end)
+        {
+            char first = exports[begin].first[prefixLength];
+            size_t groupEnd = begin;
+            while (groupEnd < end && exports[groupEnd].first[prefixLength] == first)
+                groupEnd++;
+
+            // The edge runs for as long as the whole group agrees.
+            const auto& a = exports[begin].first;
+            const auto& b = exports[groupEnd - 1].first;
+            size_t common = prefixLength;
+            while (common < a.size() && common < b.size() && a[common] == b[common])
+                common++;
+
+            size_t child = nodes.size();
+            nodes.emplace_back();
+            nodes[node].children.push_back({a.substr(prefixLength, common - prefixLength), child});
+            pending.push_back({child, common, begin, groupEnd});
+            begin = groupEnd;
+        }
+    }
+
+    auto terminalSize = [](const Node& node) -> size_t {
+        return node.terminal ? ULEB128Size(0) + ULEB128Size(node.address) : 0;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        uint64_t offset = 0;
+        for (auto& node : nodes)
+        {
+            if (node.offset != offset)
+            {
+                node.offset = offset;
+                changed = true;
+            }
+            size_t infoSize = terminalSize(node);
+            offset += ULEB128Size(infoSize) + infoSize + 1;
+            for (const auto& [label, child] : node.children)
+                offset += label.size() + 1 + ULEB128Size(nodes[child].offset);
+        }
+    }
+
+    std::vector<uint8_t> out;
+    for (const auto& node : nodes)
+    {
+        size_t infoSize = terminalSize(node);
+        AppendULEB128(out, infoSize);
+        if (node.terminal)
+        {
+            AppendULEB128(out, 0); // flags: regular
+            AppendULEB128(out, node.address);
+        }
+        out.push_back((uint8_t)node.children.size());
+        for (const auto& [label, child] : node.children)
+        {
+            out.insert(out.end(), label.begin(), label.end());
+            out.push_back(0);
+            AppendULEB128(out, nodes[child].offset);
+        }
+    }
+    return out;
+}
+
+
+// Mach-O segment and section names fill all 16 bytes when they're that long, with no terminator.
+static void SetName(char (&field)[16], const char* name)
+{
+    memset(field, 0, sizeof(field));
+    memcpy(field, name, std::min(strlen(name), sizeof(field)));
+}
+
+
+// ".01", ".02", ... as large and iOS 16 caches name their subcaches.
+static std::string SubCacheExtension(uint32_t index)
+{
+    return (index < 10 ? ".0" : ".") + std::to_string(index);
+}
+
+
+static std::string InstallName(uint32_t image)
+{
+    return "/usr/lib/libsynth" + std::to_string(image) + ".dylib";
+}
+
+
+static size_t TextSectionCount(const SyntheticCacheOptions& options)
+{
+    return options.classesPerImage ? 4 : 1;
+}
+
+
+static uint64_t LoadCommandsSize(const SyntheticCacheOptions& options, uint32_t image)
+{
+    uint64_t size = sizeof(MachO::segment_command_64) + TextSectionCount(options) * sizeof(MachO::section_64);
+    if (options.classesPerImage)
+        size += sizeof(MachO::segment_command_64) + 4 * sizeof(MachO::section_64);
+    size += sizeof(MachO::segment_command_64); // __LINKEDIT
+    size += Align(sizeof(DylibCommand) + InstallName(image).size() + 1, 8);
+    if (image)
+        size += Align(sizeof(DylibCommand) + InstallName(0).size() + 1, 8);
+    size += sizeof(UUIDCommand) + sizeof(SymtabCommand);
+    if (options.exportsPerImage)
+        size += sizeof(MachO::linkedit_data_command);
+    return size;
+}
+
+
+static uint64_t CodeSize(const SyntheticCacheOptions& options)
+{
+    uint64_t functions = (uint64_t)options.exportsPerImage + (uint64_t)options.classesPerImage * options.methodsPerClass
+                         + options.localsPerImage;
+    return Align(std::max<uint64_t>({options.textSizePerImage, functions * 4, 16}), 16);
+}
+
+
+// Functions are laid out exports first, then methods, then locals; each is a single `ret`.
+static uint64_t ExportAddress(const ImagePlan& image, uint32_t exportIndex)
+{
+    return image.codeAddress + (uint64_t)exportIndex * 4;
+}
+
+
+static uint64_t MethodAddress(const SyntheticCacheOptions& options, const ImagePlan& image, uint32_t cls, uint32_t method)
+{
+    return image.codeAddress + ((uint64_t)options.exportsPerImage + (uint64_t)cls * options.methodsPerClass + method) * 4;
+}
+
+
+static uint64_t LocalAddress(const SyntheticCacheOptions& options, const ImagePlan& image, uint32_t local)
+{
+    return image.codeAddress + ((uint64_t)options.exportsPerImage
+                                + (uint64_t)options.classesPerImage * options.methodsPerClass + local) * 4;
+}
+
+
+static uint64_t MethodListSize(const SyntheticCacheOptions& options)
+{
+    return Align(8 + (uint64_t)RelativeMethodSize * options.methodsPerClass, 8);
+}
+
+
+// class_ro_t, the metaclass' class_ro_t, then the method list, for each class.
+static uint64_t ConstStride(const SyntheticCacheOptions& options)
+{
+    return 2 * ClassROSize + MethodListSize(options);
+}
+
+
+static void PlanText(const SyntheticCacheOptions& options, ImagePlan& image, uint64_t address, uint64_t fileOffset)
+{
+    image.textSegmentAddress = address;
+    image.textSegmentOffset = fileOffset;
+    image.loadCommandsSize = LoadCommandsSize(options, image.index);
+
+    uint64_t cursor = Align(sizeof(MachO::mach_header_64) + image.loadCommandsSize, 16);
+    image.codeAddress = address + cursor;
+    image.codeSize = CodeSize(options);
+    cursor += image.codeSize;
+
+    image.methodTypesAddress = address + cursor;
+    cursor += strlen(MethodTypes) + 1;
+
+    image.methodNamesAddress = address + cursor;
+    image.methodNamesSize = 0;
+    for (uint32_t m = 0; m < options.methodsPerClass; m++)
+    {
+        image.methodNameOffsets.push_back((uint32_t)image.methodNamesSize);
+        image.methodNamesSize += ("synthMethod" + std::to_string(m)).size() + 1;
+    }
+    cursor += image.methodNamesSize;
+
+    image.classNamesAddress = address + cursor;
+    image.classNamesSize = 0;
+    for (uint32_t c = 0; c < options.classesPerImage; c++)
+    {
+        image.classNameOffsets.push_back((uint32_t)image.classNamesSize);
+        image.classNamesSize += ("SynthClass" + std::to_string(image.index) + "_" + std::to_string(c)).size() + 1;
+    }
+    cursor += image.classNamesSize;
+
+    image.textSegmentSize = Align(cursor, SegmentAlignment);
+}
+
+
+static void PlanData(const SyntheticCacheOptions& options, ImagePlan& image, uint64_t address, uint64_t fileOffset)
+{
+    if (!options.classesPerImage)
+        return;
+    image.dataSegmentAddress = address;
+    image.dataSegmentOffset = fileOffset;
+
+    uint64_t cursor = 0;
+    image.classListAddress = address + cursor;
+    cursor += 8 * (uint64_t)options.classesPerImage;
+    image.selectorRefsAddress = address + cursor;
+    cursor += 8 * (uint64_t)options.methodsPerClass;
+    image.constAddress = address + cursor;
+    image.constSize = ConstStride(options) * options.classesPerImage;
+    cursor += image.constSize;
+    image.classesAddress = address + cursor;
+    image.classesSize = 2 * ClassSize * options.classesPerImage;
+    cursor += image.classesSize;
+
+    image.dataSegmentSize = Align(cursor, SegmentAlignment);
+}
+
+
+// Fills in this image's __DATA, inside the file's __DATA buffer, recording every pointer for the slide info.
+static void BuildData(const SyntheticCacheOptions& options, const ImagePlan& image, FilePlan& file)
+{
+    if (!options.classesPerImage)
+        return;
+
+    auto pointer = [&](uint64_t at, uint64_t target) {
+        file.rebases.push_back({at - file.data.address, target});
+    };
+    auto put32 = [&](uint64_t at, uint32_t value) {
+        Put(file.dataBytes, at - file.data.address, value);
+    };
+    auto relative = [&](uint64_t at, uint64_t target) {
+        int64_t delta = (int64_t)target - (int64_t)at;
+        if (delta < INT32_MIN || delta > INT32_MAX)
+            throw SyntheticCacheException("Relative method offsets don't fit in 32 bits; use more subcaches or less text");
+        Put(file.dataBytes, at - file.data.address, (int32_t)delta);
+    };
+
+    for (uint32_t m = 0; m < options.methodsPerClass; m++)
+        pointer(image.selectorRefsAddress + 8 * m, image.methodNamesAddress + image.methodNameOffsets[m]);
+
+    for (uint32_t c = 0; c < options.classesPerImage; c++)
+    {
+        uint64_t ro = image.constAddress + c * ConstStride(options);
+        uint64_t metaRO = ro + ClassROSize;
+        uint64_t methodList = metaRO + ClassROSize;
+        uint64_t cls = image.classesAddress + c * 2 * ClassSize;
+        uint64_t meta = cls + ClassSize;
+        uint64_t name = image.classNamesAddress + image.classNameOffsets[c];
+
+        pointer(image.classListAddress + 8 * c, cls);
+
+        // class_ro_t: flags, instanceStart, instanceSize, reserved, ivarLayout, name, baseMethods, ...
+        put32(ro + 4, 8);
+        put32(ro + 8, 8);
+        pointer(ro + 24, name);
+        if (options.methodsPerClass)
+            pointer(ro + 32, methodList);
+
+        put32(metaRO, ClassROMeta);
+        put32(metaRO + 4, ClassSize);
+        put32(metaRO + 8, ClassSize);
+        pointer(metaRO + 24, name);
+
+        // class_t: isa, superclass, cache, vtable, data. The metaclass is its own isa, like a root metaclass.
+        pointer(cls, meta);
+        pointer(cls + 32, ro);
+        pointer(meta, meta);
+        pointer(meta + 32, metaRO);
+
+        put32(methodList, RelativeMethodSize | RelativeMethodListFlag);
+        put32(methodList + 4, options.methodsPerClass);
+        for (uint32_t m = 0; m < options.methodsPerClass; m++)
+        {
+            uint64_t entry = methodList + 8 + (uint64_t)m * RelativeMethodSize;
+            relative(entry, image.selectorRefsAddress + 8 * m);
+            relative(entry + 4, image.methodTypesAddress);
+            relative(entry + 8, MethodAddress(options, image, c, m));
+        }
+    }
+}
+
+
+static void BuildExportTrie(const SyntheticCacheOptions& options, ImagePlan& image)
+{
+    std::vector<std::pair<std::string, uint64_t>> exports;
+    exports.reserve(options.exportsPerImage);
+    for (uint32_t e = 0; e < options.exportsPerImage; e++)
+    {
+        exports.push_back({"_synth" + std::to_string(image.index) + "_func" + std::to_string(e),
+                           ExportAddress(image, e) - image.textSegmentAddress});
+    }
+    image.exportTrie = BuildExportTrie(std::move(exports));
+}
+
+
+/*
+ * Slide info v3 over the file's __DATA: on each page, every pointer holds its (unslid) target in the low 43 bits and
+ *  the distance to the next pointer on the page, in 8 byte strides, at bit 51.
+ */
+static void BuildSlideInfo(FilePlan& file)
+{
+    auto& rebases = file.rebases;
+    std::sort(rebases.begin(), rebases.end());
+
+    size_t pageCount = file.data.size / CachePageSize;
+    std::vector<uint16_t> pageStarts(pageCount, DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE);
+    for (size_t i = 0; i < rebases.size(); i++)
+    {
+        auto [offset, target] = rebases[i];
+        uint64_t value = target;
+        size_t page = offset / CachePageSize;
+        if (i == 0 || rebases[i - 1].first / CachePageSize != page)
+            pageStarts[page] = (uint16_t)(offset % CachePageSize);
+        if (i + 1 < rebases.size() && rebases[i + 1].first / CachePageSize == page)
+            value |= ((rebases[i + 1].first - offset) / 8) << 51;
+        Put(file.dataBytes, offset, value);
+    }
+
+    dyld_cache_slide_info3 info{};
+    info.version = 3;
+    info.page_size = CachePageSize;
+    info.page_starts_count = (uint32_t)pageCount;
+    info.auth_value_add = CacheBaseAddress;
+    file.slideInfo.clear();
+    Append(file.slideInfo, info);
+    for (auto start : pageStarts)
+        Append(file.slideInfo, start);
+}
+
+
+static void WriteImageText(const SyntheticCacheOptions& options, const ImagePlan& image, const FilePlan& file,
+                           uint32_t dependencyImage, FileWriter& out)
+{
+    std::vector<uint8_t> header;
+    header.reserve(sizeof(MachO::mach_header_64) + image.loadCommandsSize);
+
+    MachO::mach_header_64 mh{};
+    mh.magic = 0xfeedfacf;
+    mh.cputype = 0x0100000c;  // CPU_TYPE_ARM64
+    mh.filetype = 6;          // MH_DYLIB
+    mh.ncmds = 0;
+    mh.sizeofcmds = (uint32_t)image.loadCommandsSize;
+    mh.flags = 0x80000000;    // MH_DYLIB_IN_CACHE
+    Append(header, mh);
+
+    auto section = [&](const char* segment, const char* name, uint64_t address, uint64_t size, uint64_t segmentAddress,
+                       uint64_t segmentOffset, uint32_t flags) {
+        MachO::section_64 sect{};
+        SetName(sect.segname, segment);
+        SetName(sect.sectname, name);
+        sect.addr = address;
+        sect.size = size;
+        sect.offset = (uint32_t)(segmentOffset + (address - segmentAddress));
+        sect.align = 3;
+        sect.flags = flags;
+        Append(header, sect);
+    };
+
+    MachO::segment_command_64 text{};
+    text.cmd = LC_SEGMENT_64;
+    text.cmdsize = (uint32_t)(sizeof(text) + TextSectionCount(options) * sizeof(MachO::section_64));
+    SetName(text.segname, "__TEXT");
+    text.vmaddr = image.textSegmentAddress;
+    text.vmsize = image.textSegmentSize;
+    text.fileoff = image.textSegmentOffset;
+    text.filesize = image.textSegmentSize;
+    text.maxprot = text.initprot = VMProtRead | VMProtExecute;
+    text.nsects = (uint32_t)TextSectionCount(options);
+    Append(header, text);
+    mh.ncmds++;
+    section("__TEXT", "__text", image.codeAddress, image.codeSize, text.vmaddr, text.fileoff, 0x80000400);
+    if (options.classesPerImage)
+    {
+        section("__TEXT", "__objc_methtype", image.methodTypesAddress, strlen(MethodTypes) + 1, text.vmaddr, text.fileoff, 2);
+        section("__TEXT", "__objc_methname", image.methodNamesAddress, image.methodNamesSize, text.vmaddr, text.fileoff, 2);
+        section("__TEXT", "__objc_classname", image.classNamesAddress, image.classNamesSize, text.vmaddr, text.fileoff, 2);
+    }
+
+    if (options.classesPerImage)
+    {
+        MachO::segment_command_64 data{};
+        data.cmd = LC_SEGMENT_64;
+        data.cmdsize = sizeof(data) + 4 * sizeof(MachO::section_64);
+        SetName(data.segname, "__DATA");
+        data.vmaddr = image.dataSegmentAddress;
+        data.vmsize = image.dataSegmentSize;
+        data.fileoff = image.dataSegmentOffset;
+        data.filesize = image.dataSegmentSize;
+        data.maxprot = data.initprot = VMProtRead | VMProtWrite;
+        data.nsects = 4;
+        Append(header, data);
+        mh.ncmds++;
+        section("__DATA", "__objc_classlist", image.classListAddress, 8 * (uint64_t)options.classesPerImage,
+                data.vmaddr, data.fileoff, 0x10000000);
+        section("__DATA", "__objc_selrefs", image.selectorRefsAddress, 8 * (uint64_t)options.methodsPerClass,
+                data.vmaddr, data.fileoff, 0x10000005);
+        section("__DATA", "__objc_const", image.constAddress, image.constSize, data.vmaddr, data.fileoff, 0);
+        section("__DATA", "__objc_data", image.classesAddress, image.classesSize, data.vmaddr, data.fileoff, 0);
+    }
+
+    // Every image's __LINKEDIT is the whole shared one, as in real caches.
+    MachO::segment_command_64 linkedit{};
+    linkedit.cmd = LC_SEGMENT_64;
+    linkedit.cmdsize = sizeof(linkedit);
+    SetName(linkedit.segname, "__LINKEDIT");
+    linkedit.vmaddr = file.linkedit.address;
+    linkedit.vmsize = file.linkedit.size;
+    linkedit.fileoff = file.linkedit.fileOffset;
+    linkedit.filesize = file.linkedit.size;
+    linkedit.maxprot = linkedit.initprot = VMProtRead;
+    Append(header, linkedit);
+    mh.ncmds++;
+
+    auto dylib = [&](uint32_t cmd, const std::string& name) {
+        DylibCommand command{};
+        command.cmd = cmd;
+        command.cmdsize = (uint32_t)Align(sizeof(command) + name.size() + 1, 8);
+        command.nameOffset = sizeof(command);
+        command.currentVersion = command.compatibilityVersion = 0x10000;
+        Append(header, command);
+        header.insert(header.end(), name.begin(), name.end());
+        header.resize(header.size() + command.cmdsize - sizeof(command) - name.size());
+        mh.ncmds++;
+    };
+    dylib(LoadCommandIdDylib, image.installName);
+    if (image.index)
+        dylib(LoadCommandLoadDylib, InstallName(dependencyImage));
+
+    UUIDCommand uuid{};
+    uuid.cmd = LC_UUID;
+    uuid.cmdsize = sizeof(uuid);
+    memcpy(uuid.uuid, image.uuid, sizeof(uuid.uuid));
+    Append(header, uuid);
+    mh.ncmds++;
+
+    // Symbols live unmapped in the local symbols chunk; the image's own table is empty.
+    SymtabCommand symtab{};
+    symtab.cmd = LoadCommandSymtab;
+    symtab.cmdsize = sizeof(symtab);
+    symtab.symoff = symtab.stroff = (uint32_t)file.linkedit.fileOffset;
+    Append(header, symtab);
+    mh.ncmds++;
+
+    if (!image.exportTrie.empty())
+    {
+        MachO::linkedit_data_command trie{};
+        trie.cmd = LC_DYLD_EXPORTS_TRIE;
+        trie.cmdsize = sizeof(trie);
+        trie.dataoff = (uint32_t)image.exportTrieOffset;
+        trie.datasize = (uint32_t)image.exportTrie.size();
+        Append(header, trie);
+        mh.ncmds++;
+    }
+
+    if (header.size() != sizeof(mh) + image.loadCommandsSize)
+        throw SyntheticCacheException("Load command size mismatch for " + image.installName);
+    Put(header, 0, mh);
+
+    out.PadTo(image.textSegmentOffset);
+    out.Write(header.data(), header.size());
+
+    out.PadTo(image.textSegmentOffset + (image.codeAddress - image.textSegmentAddress));
+    std::vector<uint32_t> code(std::min<uint64_t>(image.codeSize / 4, 0x40000), Arm64Ret);
+    for (uint64_t written = 0; written < image.codeSize;)
+    {
+        uint64_t chunk = std::min<uint64_t>(image.codeSize - written, code.size() * 4);
+        out.Write(code.data(), chunk);
+        written += chunk;
+    }
+
+    std::string strings(MethodTypes);
+    strings.push_back('\0');
+    for (uint32_t m = 0; m < options.methodsPerClass; m++)
+    {
+        strings += "synthMethod" + std::to_string(m);
+        strings.push_back('\0');
+    }
+    for (uint32_t c = 0; c < options.classesPerImage; c++)
+    {
+        strings += "SynthClass" + std::to_string(image.index) + "_" + std::to_string(c);
+        strings.push_back('\0');
+    }
+    out.Write(strings.data(), strings.size());
+    out.PadTo(image.textSegmentOffset + image.textSegmentSize);
+}
+
+
+static size_t HeaderSize(const SyntheticCacheOptions& options, uint32_t fileIndex, const std::vector<ImagePlan>& images)
+{
+    size_t size = sizeof(dyld_cache_header) + 3 * sizeof(dyld_cache_mapping_info)
+                  + 3 * sizeof(dyld_cache_mapping_and_slide_info);
+    if (fileIndex == 0)
+    {
+        size += images.size() * sizeof(dyld_cache_image_info);
+        size += options.subCacheCount * (options.format == SplitCacheFormat ? sizeof(dyld_subcache_entry)
+                                                                            : sizeof(dyld_subcache_entry2));
+        for (const auto& image : images)
+            size += image.installName.size() + 1;
+    }
+    return size;
+}
+
+
+static void FillCommonHeader(dyld_cache_header& header, const SyntheticCacheOptions& options, const FilePlan& file)
+{
+    memcpy(header.magic, "dyld_v1   arm64", 16);
+    header.mappingOffset = sizeof(dyld_cache_header);
+    header.mappingCount = 3;
+    header.mappingWithSlideOffset = sizeof(dyld_cache_header) + 3 * sizeof(dyld_cache_mapping_info);
+    header.mappingWithSlideCount = 3;
+    memcpy(header.uuid, file.uuid, sizeof(header.uuid));
+    header.cacheType = options.format == iOS16CacheFormat ? 2 : 0;
+    header.platform = 2; // iOS
+    header.sharedRegionStart = CacheBaseAddress;
+}
+
+
+static void WriteFile(const SyntheticCacheOptions& options, const FilePlan& file, std::vector<ImagePlan>& images,
+                      const std::vector<FilePlan>& files, const uint8_t symbolsUUID[16], uint64_t cacheEnd,
+                      std::vector<uint8_t>* localSymbols)
+{
+    bool base = &file == &files.front();
+    std::vector<uint8_t> header(file.headerSize);
+
+    dyld_cache_header cacheHeader{};
+    FillCommonHeader(cacheHeader, options, file);
+    if (base)
+        cacheHeader.sharedRegionSize = cacheEnd - CacheBaseAddress;
+
+    const Mapping* mappings[3] = {&file.text, &file.data, &file.linkedit};
+    const uint32_t protections[3] = {VMProtRead | VMProtExecute, VMProtRead | VMProtWrite, VMProtRead};
+    for (size_t i = 0; i < 3; i++)
+    {
+        dyld_cache_mapping_info mapping{mappings[i]->address, mappings[i]->size, mappings[i]->fileOffset,
+                                        protections[i], protections[i]};
+        Put(header, cacheHeader.mappingOffset + i * sizeof(mapping), mapping);
+
+        dyld_cache_mapping_and_slide_info slid{mappings[i]->address, mappings[i]->size, mappings[i]->fileOffset,
+                                               0, 0, 0, protections[i], protections[i]};
+        if (i == 1 && !file.slideInfo.empty())
+        {
+            slid.slideInfoFileOffset = file.slideInfoOffset;
+            slid.slideInfoFileSize = file.slideInfo.size();
+        }
+        Put(header, cacheHeader.mappingWithSlideOffset + i * sizeof(slid), slid);
+    }
+
+    if (base)
+    {
+        uint64_t cursor = cacheHeader.mappingWithSlideOffset + 3 * sizeof(dyld_cache_mapping_and_slide_info);
+        uint64_t imagesOffset = cursor;
+        cursor += images.size() * sizeof(dyld_cache_image_info);
+
+        if (options.format == RegularCacheFormat)
+        {
+            cacheHeader.imagesOffsetOld = (uint32_t)imagesOffset;
+            cacheHeader.imagesCountOld = (uint32_t)images.size();
+        }
+        else
+        {
+            cacheHeader.imagesOffset = (uint32_t)imagesOffset;
+            cacheHeader.imagesCount = (uint32_t)images.size();
+            cacheHeader.subCacheArrayOffset = (uint32_t)cursor;
+            cacheHeader.subCacheArrayCount = options.subCacheCount;
+            memcpy(cacheHeader.symbolFileUUID, symbolsUUID, sizeof(cacheHeader.symbolFileUUID));
+        }
+
+        for (uint32_t s = 1; s < files.size(); s++)
+        {
+            uint64_t vmOffset = files[s].text.address - CacheBaseAddress;
+            if (options.format == SplitCacheFormat)
+            {
+                dyld_subcache_entry entry{};
+                memcpy(entry.uuid, files[s].uuid, sizeof(entry.uuid));
+                entry.address = vmOffset;
+                Put(header, cursor, entry);
+                cursor += sizeof(entry);
+            }
+            else
+            {
+                dyld_subcache_entry2 entry{};
+                memcpy(entry.uuid, files[s].uuid, sizeof(entry.uuid));
+                entry.address = vmOffset;
+                auto extension = SubCacheExtension(s);
+                memcpy(entry.fileExtension, extension.c_str(), std::min(extension.size() + 1, sizeof(entry.fileExtension)));
+                Put(header, cursor, entry);
+                cursor += sizeof(entry);
+            }
+        }
+
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            dyld_cache_image_info info{};
+            info.address = images[i].textSegmentAddress;
+            info.pathFileOffset = (uint32_t)cursor;
+            Put(header, imagesOffset + i * sizeof(info), info);
+            memcpy(header.data() + cursor, images[i].installName.c_str(), images[i].installName.size() + 1);
+            cursor += images[i].installName.size() + 1;
+        }
+
+        // Regular caches keep their unmapped locals at the end of the base file.
+        if (localSymbols)
+        {
+            cacheHeader.localSymbolsOffset = Align(file.end, 8);
+            cacheHeader.localSymbolsSize = localSymbols->size();
+        }
+    }
+    Put(header, 0, cacheHeader);
+
+    FileWriter out(file.path);
+    out.Write(header.data(), header.size());
+    for (uint32_t i = file.firstImage; i < file.firstImage + file.imageCount; i++)
+        WriteImageText(options, images[i], file, 0, out);
+
+    out.PadTo(file.data.fileOffset);
+    out.Write(file.dataBytes.data(), file.dataBytes.size());
+    out.PadTo(file.linkedit.fileOffset);
+    out.Write(file.linkeditBytes.data(), file.linkeditBytes.size());
+    out.PadTo(file.linkedit.fileOffset + file.linkedit.size);
+    if (!file.slideInfo.empty())
+    {
+        out.PadTo(file.slideInfoOffset);
+        out.Write(file.slideInfo.data(), file.slideInfo.size());
+    }
+    if (base && localSymbols)
+    {
+        out.PadTo(cacheHeader.localSymbolsOffset);
+        out.Write(localSymbols->data(), localSymbols->size());
+    }
+    out.Close();
+}
+
+
+// dyld_cache_local_symbols_info, nlists, entries, then strings. Entries locate images by VM offset from the cache base.
+static std::vector<uint8_t> BuildLocalSymbols(const SyntheticCacheOptions& options, const std::vector<ImagePlan>& images)
+{
+    std::vector<MachO::nlist_64> nlists;
+    std::vector<dyld_cache_local_symbols_entry_64> entries;
+    std::string strings(1, '\0');
+    for (const auto& image : images)
+    {
+        dyld_cache_local_symbols_entry_64 entry{};
+        entry.dylibOffset = image.textSegmentAddress - CacheBaseAddress;
+        entry.nlistStartIndex = (uint32_t)nlists.size();
+        entry.nlistCount = options.localsPerImage;
+        entries.push_back(entry);
+        for (uint32_t l = 0; l < options.localsPerImage; l++)
+        {
+            MachO::nlist_64 nlist{};
+            nlist.n_strx = (uint32_t)strings.size();
+            nlist.n_type = N_SECT;
+            nlist.n_sect = 1;
+            nlist.n_value = LocalAddress(options, image, l);
+            nlists.push_back(nlist);
+            strings += "_synth" + std::to_string(image.index) + "_local" + std::to_string(l);
+            strings.push_back('\0');
+        }
+    }
+
+    dyld_cache_local_symbols_info info{};
+    info.nlistOffset = sizeof(info);
+    info.nlistCount = (uint32_t)nlists.size();
+    info.entriesOffset = (uint32_t)(info.nlistOffset + nlists.size() * sizeof(MachO::nlist_64));
+    info.entriesCount = (uint32_t)entries.size();
+    info.stringsOffset = (uint32_t)(info.entriesOffset + entries.size() * sizeof(dyld_cache_local_symbols_entry_64));
+    info.stringsSize = (uint32_t)strings.size();
+
+    std::vector<uint8_t> out;
+    Append(out, info);
+    for (const auto& nlist : nlists)
+        Append(out, nlist);
+    for (const auto& entry : entries)
+        Append(out, entry);
+    out.insert(out.end(), strings.begin(), strings.end());
+    return out;
+}
+
+
+static void WriteSymbolsFile(const std::string& path, const SyntheticCacheOptions& options, const uint8_t uuid[16],
+                             const std::vector<uint8_t>& localSymbols)
+{
+    dyld_cache_header header{};
+    memcpy(header.magic, "dyld_v1   arm64", 16);
+    header.mappingOffset = sizeof(dyld_cache_header);
+    header.mappingWithSlideOffset = sizeof(dyld_cache_header);
+    memcpy(header.uuid, uuid, sizeof(header.uuid));
+    header.cacheType = options.format == iOS16CacheFormat ? 2 : 0;
+    header.localSymbolsOffset = Align(sizeof(dyld_cache_header), 8);
+    header.localSymbolsSize = localSymbols.size();
+
+    FileWriter out(path);
+    out.Write(&header, sizeof(header));
+    out.PadTo(header.localSymbolsOffset);
+    out.Write(localSymbols.data(), localSymbols.size());
+    out.Close();
+}
+
+
+std::vector<std::string> SyntheticCache::Write(const std::string& path, const SyntheticCacheOptions& requested)
+{
+    auto options = requested;
+    if (options.format == RegularCacheFormat)
+        options.subCacheCount = 0;
+    else if (options.subCacheCount == 0)
+        throw SyntheticCacheException("Split, large and iOS 16 style caches need at least one subcache");
+    if (options.imageCount == 0)
+        throw SyntheticCacheException("A cache needs at least one image");
+    if (options.imageCount < options.subCacheCount + 1)
+        throw SyntheticCacheException("Every file needs at least one image; use fewer subcaches or more images");
+    if (options.methodsPerClass > 0x10000 || options.classesPerImage > 0x100000)
+        throw SyntheticCacheException("Too many classes or methods per image");
+
+    std::vector<ImagePlan> images(options.imageCount);
+    for (uint32_t i = 0; i < options.imageCount; i++)
+    {
+        images[i].index = i;
+        images[i].installName = InstallName(i);
+        MakeUUID(images[i].uuid, options.seed, 1, i);
+    }
+
+    // Images are shared out evenly, in order; each file is its own contiguous run of the address space.
+    uint32_t fileCount = options.subCacheCount + 1;
+    std::vector<FilePlan> files(fileCount);
+    uint64_t address = CacheBaseAddress;
+    for (uint32_t f = 0; f < fileCount; f++)
+    {
+        auto& file = files[f];
+        file.firstImage = (uint32_t)((uint64_t)options.imageCount * f / fileCount);
+        file.imageCount = (uint32_t)((uint64_t)options.imageCount * (f + 1) / fileCount) - file.firstImage;
+        MakeUUID(file.uuid, options.seed, 0, f);
+        if (f == 0)
+            file.path = path;
+        else if (options.format == SplitCacheFormat)
+            file.path = path + "." + std::to_string(f);
+        else
+            file.path = path + SubCacheExtension(f);
+        file.headerSize = HeaderSize(options, f, images);
+
+        uint64_t offset = Align(file.headerSize, SegmentAlignment);
+        file.text = {address, 0, 0};
+        for (uint32_t i = file.firstImage; i < file.firstImage + file.imageCount; i++)
+        {
+            PlanText(options, images[i], address + offset, offset);
+            offset += images[i].textSegmentSize;
+        }
+        offset = Align(offset, CachePageSize);
+        file.text.size = offset;
+
+        file.data = {address + offset, offset, 0};
+        for (uint32_t i = file.firstImage; i < file.firstImage + file.imageCount; i++)
+        {
+            PlanData(options, images[i], address + offset, offset);
+            offset += images[i].dataSegmentSize;
+        }
+        file.data.size = Align(offset - file.data.fileOffset, CachePageSize);
+        offset = file.data.fileOffset + file.data.size;
+
+        file.linkedit = {address + offset, offset, 0};
+        for (uint32_t i = file.firstImage; i < file.firstImage + file.imageCount; i++)
+        {
+            BuildExportTrie(options, images[i]);
+            if (images[i].exportTrie.empty())
+                continue;
+            file.linkeditBytes.resize(Align(file.linkeditBytes.size(), 8));
+            images[i].exportTrieOffset = file.linkedit.fileOffset + file.linkeditBytes.size();
+            file.linkeditBytes.insert(file.linkeditBytes.end(), images[i].exportTrie.begin(), images[i].exportTrie.end());
+        }
+        file.linkedit.size = std::max(Align(file.linkeditBytes.size(), CachePageSize), CachePageSize);
+        offset += file.linkedit.size;
+
+        file.dataBytes.assign(file.data.size, 0);
+        for (uint32_t i = file.firstImage; i < file.firstImage + file.imageCount; i++)
+            BuildData(options, images[i], file);
+        if (options.slideInfo && !file.rebases.empty())
+        {
+            BuildSlideInfo(file);
+            file.slideInfoOffset = offset;
+            offset += file.slideInfo.size();
+        }
+        else
+        {
+            for (const auto& [at, target] : file.rebases)
+                Put(file.dataBytes, at, target);
+        }
+        file.end = offset;
+
+        address += Align(offset, CachePageSize);
+    }
+
+    // Split caches always have a .symbols file; iOS 16 ones only when there are locals to put in it.
+    bool symbolsFile = options.format == SplitCacheFormat
+                       || (options.format == iOS16CacheFormat && options.localsPerImage);
+    bool baseLocals = options.format == RegularCacheFormat && options.localsPerImage;
+    std::vector<uint8_t> localSymbols;
+    if (symbolsFile || baseLocals)
+        localSymbols = BuildLocalSymbols(options, images);
+
+    uint8_t symbolsUUID[16] = {};
+    if (symbolsFile)
+        MakeUUID(symbolsUUID, options.seed, 2, 0);
+
+    std::vector<std::string> written;
+    for (const auto& file : files)
+    {
+        WriteFile(options, file, images, files, symbolsUUID, address, baseLocals ? &localSymbols : nullptr);
+        written.push_back(file.path);
+    }
+    if (symbolsFile)
+    {
+        WriteSymbolsFile(path + ".symbols", options, symbolsUUID, localSymbols);
+        written.push_back(path + ".symbols");
+    }
+    return written;
+}
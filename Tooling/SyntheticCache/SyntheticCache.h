@@ -0,0 +1,56 @@
+#ifndef KSUITE_SYNTHETICCACHE_H
+#define KSUITE_SYNTHETICCACHE_H
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+#include "CacheDescriptor.h"
+
+
+class SyntheticCacheException : public std::exception
+{
+    std::string m_message;
+
+public:
+    explicit SyntheticCacheException(std::string message) : m_message(std::move(message)) {}
+
+    virtual const char* what() const throw()
+    {
+        return m_message.c_str();
+    }
+};
+
+
+struct SyntheticCacheOptions {
+    SharedCacheFormat format = iOS16CacheFormat;
+    uint32_t imageCount = 64;
+    uint32_t subCacheCount = 4;       // files besides the base one; regular caches never have any
+    uint32_t exportsPerImage = 128;
+    uint32_t classesPerImage = 16;
+    uint32_t methodsPerClass = 8;     // relative method lists, one selector reference per method name
+    uint32_t localsPerImage = 32;     // unmapped locals, in .symbols (or the base file of a regular cache; large caches have none)
+    uint64_t textSizePerImage = 0x10000; // grown if the exports and methods need more room
+    bool slideInfo = true;            // v3 slide info over every __DATA pointer; raw pointers otherwise
+    uint32_t seed = 0;                // mixed into every file's UUID
+};
+
+
+/*
+ * Writes arm64 dyld shared caches made up from scratch, in any of the layouts the loader handles, for measuring it
+ *  without shipping Apple's caches around.
+ *
+ * Each file gets the images in its share laid out like a real cache: __TEXT (mach header, code, ObjC strings),
+ *  __DATA (class lists, classes, relative method lists, selector references) and one shared __LINKEDIT holding the
+ *  export tries. Files are written a piece at a time, so caches of several gigabytes don't need that much memory;
+ *  size is set by textSizePerImage.
+ */
+class SyntheticCache {
+public:
+    // Writes the base file at `path` and its subcaches next to it. Returns every file written, base first.
+    // Throws SyntheticCacheException if the options can't make a valid cache or a file can't be written.
+    static std::vector<std::string> Write(const std::string& path, const SyntheticCacheOptions& options);
+};
+
+
+#endif //KSUITE_SYNTHETICCACHE_H
@@ -0,0 +1,65 @@
+#ifndef KSUITE_SYNTHETICCACHE_TOOLOPTIONS_H
+#define KSUITE_SYNTHETICCACHE_TOOLOPTIONS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include "SyntheticCache.h"
+
+/*
+ * Command line parsing shared by dscgen and dscbench. Everything throws SyntheticCacheException on bad input.
+ */
+
+// Sizes and counts: decimal or 0x hex, with an optional K, M or G suffix.
+inline uint64_t ParseSize(const char* text)
+{
+    char* end;
+    uint64_t value = strtoull(text, &end, 0);
+    if (end == text)
+        throw SyntheticCacheException(std::string("Bad number: ") + text);
+    switch (*end)
+    {
+    case 'g': case 'G': value <<= 30; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'k': case 'K': value <<= 10; end++; break;
+    default: break;
+    }
+    if (*end)
+        throw SyntheticCacheException(std::string("Bad number: ") + text);
+    return value;
+}
+
+
+inline uint32_t ParseCount(const char* text)
+{
+    uint64_t value = ParseSize(text);
+    if (value > UINT32_MAX)
+        throw SyntheticCacheException(std::string("Number too large: ") + text);
+    return (uint32_t)value;
+}
+
+
+inline SharedCacheFormat ParseFormat(const std::string& text)
+{
+    if (text == "regular")
+        return RegularCacheFormat;
+    if (text == "split")
+        return SplitCacheFormat;
+    if (text == "large")
+        return LargeCacheFormat;
+    if (text == "ios16")
+        return iOS16CacheFormat;
+    throw SyntheticCacheException("Unknown format: " + text);
+}
+
+
+// __TEXT is nearly all of a cache, so spreading a target size evenly over the images gets close enough.
+inline uint64_t TextSizeForTarget(uint64_t targetSize, uint32_t imageCount)
+{
+    if (imageCount == 0)
+        throw SyntheticCacheException("A cache needs at least one image");
+    return targetSize / imageCount;
+}
+
+
+#endif //KSUITE_SYNTHETICCACHE_TOOLOPTIONS_H
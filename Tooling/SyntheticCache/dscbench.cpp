@@ -0,0 +1,251 @@
+/*
+ * Measures how the shared cache core scales: generates a synthetic cache per point of a sweep (or takes a real one)
+ *  and times opening it, building the address and symbol indexes, and walking every image's ObjC class list.
+ *
+ * Nothing is cached between runs: no index directory is set, and each cache is released before the next is written.
+ *  The files were just written though, so they're usually in the page cache; these are warm open numbers.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include "CacheSession.h"
+#include "SyntheticCache.h"
+#include "ToolOptions.h"
+
+
+static void Usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --cache PATH                         measure an existing cache instead of generating any\n"
+            "  --scale images|subcaches|exports|classes\n"
+            "                                       what the sweep varies (default images)\n"
+            "  --points N,N,...                     values to sweep over (default 64,256,1024)\n"
+            "  --format regular|split|large|ios16   layout of generated caches (default ios16)\n"
+            "  --images N, --subcaches N, --exports N, --classes N, --methods N, --locals N\n"
+            "                                       fixed values for everything not being swept\n"
+            "  --target-size BYTES                  size of each generated cache (default: 64K of text per image)\n"
+            "  --dir PATH                           where to write generated caches (default .)\n"
+            "sizes take K, M and G suffixes\n",
+            program);
+}
+
+
+namespace {
+    struct Measurement {
+        uint64_t size = 0;
+        double open = 0;
+        double addressIndex = 0;
+        double symbolIndex = 0;
+        size_t symbols = 0;
+        double objc = 0;
+        size_t classes = 0;
+    };
+
+    class Stopwatch {
+        std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+    public:
+        // Milliseconds since construction or the last lap.
+        double Lap()
+        {
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double, std::milli>(now - m_start).count();
+            m_start = now;
+            return elapsed;
+        }
+    };
+}
+
+
+static Measurement Measure(const std::string& path)
+{
+    Measurement result;
+    Stopwatch stopwatch;
+
+    auto session = CacheSession::Acquire(path);
+    if (!session)
+        throw SyntheticCacheException("Couldn't open " + path);
+    result.open = stopwatch.Lap();
+
+    // The address index is built on the first lookup.
+    session->SegmentAt(session->Images().empty() ? 0 : session->Images()[0].headerAddress);
+    result.addressIndex = stopwatch.Lap();
+
+    auto index = session->GetSymbolIndex();
+    result.symbolIndex = stopwatch.Lap();
+    result.symbols = index ? index->Size() : 0;
+
+    // Roughly what ObjC discovery does before it gets to the view: every class, its class_ro_t and name.
+    auto vm = session->GetVM();
+    for (size_t i = 0; i < session->Images().size(); i++)
+    {
+        auto classList = session->SectionNamed(i, "__DATA", "__objc_classlist");
+        if (!classList)
+            continue;
+        try {
+            for (uint64_t entry = classList->start; entry + 8 <= classList->end; entry += 8)
+            {
+                uint64_t ro = vm->ReadULong(vm->ReadULong(entry) + 32) & 0x7ffffffffff8;
+                if (!vm->ReadNullTermString(vm->ReadULong(ro + 24)).empty())
+                    result.classes++;
+            }
+        }
+        catch (MappingReadException& exc)
+        {
+            // Class in a subcache that isn't there; real caches have those too.
+        }
+    }
+    result.objc = stopwatch.Lap();
+    return result;
+}
+
+
+static uint64_t FileSize(const std::string& path)
+{
+    struct stat st {};
+    return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+
+static void PrintHeader(const char* parameter)
+{
+    printf("%12s %12s %10s %12s %12s %10s %10s %10s\n", parameter, "size (MB)", "open (ms)", "address (ms)",
+           "symbols (ms)", "symbols", "objc (ms)", "classes");
+}
+
+
+static void PrintRow(const std::string& parameter, const Measurement& m)
+{
+    printf("%12s %12.1f %10.2f %12.2f %12.2f %10zu %10.2f %10zu\n", parameter.c_str(), m.size / 1048576.0, m.open,
+           m.addressIndex, m.symbolIndex, m.symbols, m.objc, m.classes);
+    fflush(stdout);
+}
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        SyntheticCacheOptions options;
+        std::string cache, scale = "images", directory = ".";
+        std::vector<uint32_t> points = {64, 256, 1024};
+        uint64_t targetSize = 0;
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> const char* {
+                if (i + 1 >= argc)
+                    throw SyntheticCacheException(arg + " needs a value");
+                return argv[++i];
+            };
+
+            if (arg == "--cache")
+                cache = value();
+            else if (arg == "--scale")
+                scale = value();
+            else if (arg == "--points")
+            {
+                points.clear();
+                std::string list = value();
+                for (size_t start = 0; start <= list.size();)
+                {
+                    size_t comma = std::min(list.find(',', start), list.size());
+                    points.push_back(ParseCount(list.substr(start, comma - start).c_str()));
+                    start = comma + 1;
+                }
+            }
+            else if (arg == "--format")
+                options.format = ParseFormat(value());
+            else if (arg == "--images")
+                options.imageCount = ParseCount(value());
+            else if (arg == "--subcaches")
+                options.subCacheCount = ParseCount(value());
+            else if (arg == "--exports")
+                options.exportsPerImage = ParseCount(value());
+            else if (arg == "--classes")
+                options.classesPerImage = ParseCount(value());
+            else if (arg == "--methods")
+                options.methodsPerClass = ParseCount(value());
+            else if (arg == "--locals")
+                options.localsPerImage = ParseCount(value());
+            else if (arg == "--target-size")
+                targetSize = ParseSize(value());
+            else if (arg == "--dir")
+                directory = value();
+            else if (arg == "-h" || arg == "--help")
+            {
+                Usage(argv[0]);
+                return 0;
+            }
+            else
+                throw SyntheticCacheException("Unknown option: " + arg);
+        }
+
+        if (!cache.empty())
+        {
+            auto m = Measure(cache);
+            m.size = FileSize(cache);
+            PrintHeader("cache");
+            PrintRow("-", m);
+            return 0;
+        }
+
+        if (scale != "images" && scale != "subcaches" && scale != "exports" && scale != "classes")
+            throw SyntheticCacheException("Can't scale " + scale);
+        if (options.format == RegularCacheFormat)
+            options.subCacheCount = 0;
+
+        mkdir(directory.c_str(), 0755);
+        PrintHeader(scale.c_str());
+        for (uint32_t point : points)
+        {
+            auto pointOptions = options;
+            if (scale == "images")
+            {
+                // Small points would otherwise leave subcaches without images.
+                pointOptions.imageCount = point;
+                if (point && pointOptions.subCacheCount >= point)
+                    pointOptions.subCacheCount = point - 1;
+            }
+            else if (scale == "subcaches")
+                pointOptions.subCacheCount = point;
+            else if (scale == "exports")
+                pointOptions.exportsPerImage = point;
+            else
+                pointOptions.classesPerImage = point;
+            if (targetSize)
+                pointOptions.textSizePerImage = TextSizeForTarget(targetSize, pointOptions.imageCount);
+
+            // A fresh name per point; sessions are shared by path for as long as one is alive.
+            std::string path = directory + "/dscbench_" + scale + "_" + std::to_string(point);
+            auto files = SyntheticCache::Write(path, pointOptions);
+
+            Measurement m;
+            try {
+                m = Measure(path);
+            }
+            catch (...)
+            {
+                for (const auto& file : files)
+                    remove(file.c_str());
+                throw;
+            }
+            for (const auto& file : files)
+            {
+                m.size += FileSize(file);
+                remove(file.c_str());
+            }
+            PrintRow(std::to_string(point), m);
+        }
+    }
+    catch (std::exception& e)
+    {
+        fprintf(stderr, "dscbench: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
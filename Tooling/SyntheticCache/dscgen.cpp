@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "SyntheticCache.h"
+#include "ToolOptions.h"
+
+
+static void Usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options] <output path>\n"
+            "  --format regular|split|large|ios16   cache layout (default ios16)\n"
+            "  --images N                           images in the cache (default 64)\n"
+            "  --subcaches N                        files besides the base one (default 4)\n"
+            "  --exports N                          exported functions per image (default 128)\n"
+            "  --classes N                          ObjC classes per image (default 16)\n"
+            "  --methods N                          methods per class (default 8)\n"
+            "  --locals N                           unmapped local symbols per image (default 32)\n"
+            "  --text-size BYTES                    __TEXT per image (default 64K)\n"
+            "  --target-size BYTES                  size the whole cache; overrides --text-size\n"
+            "  --no-slide                           write raw pointers, no slide info\n"
+            "  --seed N                             varies file UUIDs between runs\n"
+            "sizes take K, M and G suffixes\n",
+            program);
+}
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        SyntheticCacheOptions options;
+        std::string path;
+        uint64_t targetSize = 0;
+        bool subCachesSet = false;
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> const char* {
+                if (i + 1 >= argc)
+                    throw SyntheticCacheException(arg + " needs a value");
+                return argv[++i];
+            };
+
+            if (arg == "--format")
+                options.format = ParseFormat(value());
+            else if (arg == "--images")
+                options.imageCount = ParseCount(value());
+            else if (arg == "--subcaches")
+            {
+                options.subCacheCount = ParseCount(value());
+                subCachesSet = true;
+            }
+            else if (arg == "--exports")
+                options.exportsPerImage = ParseCount(value());
+            else if (arg == "--classes")
+                options.classesPerImage = ParseCount(value());
+            else if (arg == "--methods")
+                options.methodsPerClass = ParseCount(value());
+            else if (arg == "--locals")
+                options.localsPerImage = ParseCount(value());
+            else if (arg == "--text-size")
+                options.textSizePerImage = ParseSize(value());
+            else if (arg == "--target-size")
+                targetSize = ParseSize(value());
+            else if (arg == "--no-slide")
+                options.slideInfo = false;
+            else if (arg == "--seed")
+                options.seed = ParseCount(value());
+            else if (arg == "-h" || arg == "--help")
+            {
+                Usage(argv[0]);
+                return 0;
+            }
+            else if (!arg.empty() && arg[0] == '-')
+                throw SyntheticCacheException("Unknown option: " + arg);
+            else if (path.empty())
+                path = arg;
+            else
+                throw SyntheticCacheException("More than one output path given");
+        }
+
+        if (path.empty())
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+
+        if (options.format == RegularCacheFormat && !subCachesSet)
+            options.subCacheCount = 0;
+        if (targetSize)
+            options.textSizePerImage = TextSizeForTarget(targetSize, options.imageCount);
+
+        for (const auto& file : SyntheticCache::Write(path, options))
+            printf("%s\n", file.c_str());
+    }
+    catch (std::exception& e)
+    {
+        fprintf(stderr, "dscgen: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include "CacheDescriptor.h"
+#include "VM.h"
+
+
+static SharedCacheFormat DetectFormat(const dyld_cache_header& header, const std::string& path)
+{
+    if (header.imagesCountOld != 0)
+        return RegularCacheFormat;
+
+    size_t subCacheOff = offsetof(struct dyld_cache_header, subCacheArrayOffset);
+    size_t headerEnd = header.mappingOffset;
+    if (headerEnd > subCacheOff) {
+        if (header.cacheType != 2)
+        {
+            if (std::filesystem::exists(path + ".01"))
+                return LargeCacheFormat;
+            return SplitCacheFormat;
+        }
+        else
+            return iOS16CacheFormat;
+    }
+
+    return RegularCacheFormat;
+}
+
+
+size_t CacheDescriptor::PageSizeForMagic(const char magic[16])
+{
+    // "dyld_v1  x86_64h", "dyld_v1   arm64e", ... the architecture is right aligned after the version.
+    std::string_view arch(magic, strnlen(magic, 16));
+    if (auto space = arch.find_last_of(' '); space != std::string_view::npos)
+        arch = arch.substr(space + 1);
+
+    if (arch == "i386" || arch.substr(0, 6) == "x86_64")
+        return 0x1000;
+    return 0x4000;
+}
+
+
+CacheDescriptor CacheDescriptor::Describe(const dyld_cache_header& header, MMappedFileAccessor& baseFile)
+{
+    CacheDescriptor descriptor;
+    auto path = baseFile.Path();
+    descriptor.format = DetectFormat(header, path);
+    descriptor.pageSize = PageSizeForMagic(header.magic);
+    descriptor.files.push_back({path, CacheFileDescriptor::BaseFile, false});
+
+    if ((size_t)header.mappingOffset + (size_t)header.mappingCount * sizeof(dyld_cache_mapping_info) <= baseFile.Length())
+    {
+        descriptor.mappings.resize(header.mappingCount);
+        baseFile.Read(descriptor.mappings.data(), header.mappingOffset,
+                      header.mappingCount * sizeof(dyld_cache_mapping_info));
+    }
+
+    auto subCacheCount = header.subCacheArrayCount;
+    switch (descriptor.format)
+    {
+        case RegularCacheFormat:
+            break;
+        case SplitCacheFormat:
+            // Subcaches are numbered from 1; the symbols file is always there.
+            for (size_t i = 1; i <= subCacheCount; i++)
+                descriptor.files.push_back({path + "." + std::to_string(i), CacheFileDescriptor::SubCacheFile, false});
+            descriptor.files.push_back({path + ".symbols", CacheFileDescriptor::SymbolsFile, false});
+            break;
+        case LargeCacheFormat:
+        case iOS16CacheFormat:
+            // Subcache file names come from the header; only iOS 16 style caches may ship a symbols file.
+            for (size_t i = 0; i < subCacheCount; i++)
+            {
+                dyld_subcache_entry2 entry{};
+                baseFile.Read(&entry, header.subCacheArrayOffset + (i * sizeof(dyld_subcache_entry2)),
+                              sizeof(dyld_subcache_entry2));
+                std::string extension(entry.fileExtension, strnlen(entry.fileExtension, sizeof(entry.fileExtension)));
+                if (extension.find('.') != std::string::npos)
+                    descriptor.files.push_back({path + extension, CacheFileDescriptor::SubCacheFile, false});
+                else
+                    descriptor.files.push_back({path + "." + extension, CacheFileDescriptor::SubCacheFile, false});
+            }
+            if (descriptor.format == iOS16CacheFormat)
+                descriptor.files.push_back({path + ".symbols", CacheFileDescriptor::SymbolsFile, true});
+            break;
+    }
+
+    return descriptor;
+}
@@ -0,0 +1,52 @@
+#ifndef KSUITE_CACHEDESCRIPTOR_H
+#define KSUITE_CACHEDESCRIPTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CacheHeader.h"
+
+class MMappedFileAccessor;
+
+
+enum SharedCacheFormat {
+    RegularCacheFormat,
+    SplitCacheFormat,
+    LargeCacheFormat,
+    iOS16CacheFormat,
+};
+
+
+struct CacheFileDescriptor {
+    enum Role : uint8_t {
+        BaseFile,
+        SubCacheFile,
+        SymbolsFile, // unmapped local symbols; has no mappings of its own on most caches
+    };
+
+    std::string path;
+    Role role;
+    bool optional; // a missing optional file is skipped instead of failing the whole cache
+};
+
+
+/*
+ * Everything about a cache's on-disk layout that only depends on the base file: its format, page size,
+ *  which files make it up, and the base file's own mappings.
+ *
+ * Worked out once when a session is created. Mapping the cache is then the same loop for every format.
+ */
+struct CacheDescriptor {
+    SharedCacheFormat format = RegularCacheFormat;
+    size_t pageSize = 0x4000;
+    std::vector<CacheFileDescriptor> files; // the base file first
+    std::vector<dyld_cache_mapping_info> mappings; // of the base file
+
+    static CacheDescriptor Describe(const dyld_cache_header& header, MMappedFileAccessor& baseFile);
+
+    // The page size is 4k for Intel caches and 16k for everything else.
+    static size_t PageSizeForMagic(const char magic[16]);
+};
+
+
+#endif //KSUITE_CACHEDESCRIPTOR_H
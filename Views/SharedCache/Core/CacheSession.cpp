@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <cstring>
+#include "CacheSession.h"
+#include "IndexCache.h"
+#include "Parallel.h"
+#include "Log.h"
+#include "MachO.h"
+
+
+std::mutex CacheSession::s_sessionsMutex;
+std::map<std::string, std::weak_ptr<CacheSession>> CacheSession::s_sessions;
+
+
+CacheSession::CacheSession(std::shared_ptr<MMappedFileAccessor> baseFile) : m_baseFile(baseFile)
+{
+    m_path = m_baseFile->Path();
+
+    size_t header_size = m_baseFile->ReadUInt32(16);
+    m_baseFile->Read(&m_header, 0, std::min(header_size, sizeof(dyld_cache_header)));
+
+    static const char* hex = "0123456789ABCDEF";
+    for (uint8_t byte : m_header.uuid)
+    {
+        m_uuid += hex[byte >> 4];
+        m_uuid += hex[byte & 0xf];
+    }
+
+    m_descriptor = CacheDescriptor::Describe(m_header, *m_baseFile);
+    BuildImageTable();
+}
+
+
+namespace {
+    struct SubCacheFile {
+        std::string path;
+        bool optional = false;
+        bool symbols = false;
+        std::shared_ptr<MMappedFileAccessor> file;
+        uint8_t uuid[16] {};
+        std::vector<dyld_cache_mapping_info> mappings;
+    };
+}
+
+
+/*
+ * Opens every subcache and reads its mapping table, all at once on a thread pool.
+ *
+ * Cold opens on network storage are dominated by open/stat/mmap latency, so doing them one by one hurts.
+ * Nothing here touches the VM; MapCache merges the results afterwards in a single pass.
+ */
+static void OpenSubCaches(std::vector<SubCacheFile>& subCaches)
+{
+    ParallelFor(subCaches.size(), [&](size_t i) {
+        auto& subCache = subCaches[i];
+        try {
+            // Most subcaches are small enough to fault in whole while we're waiting on the others anyway.
+            subCache.file = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCache.path, !subCache.symbols));
+        }
+        catch (MissingFileException& exc)
+        {
+            // Images in a missing subcache just can't be read; the rest of the cache is still usable.
+            if (subCache.optional)
+                return;
+            if (subCache.symbols)
+                CoreLogError("Missing %s, local symbols won't be available", subCache.path.c_str());
+            else
+                CoreLogError("Missing %s, images it holds won't be readable", subCache.path.c_str());
+            return;
+        }
+
+        auto& file = subCache.file;
+        if (file->Length() < 0x20 || strncmp((const char*)file->Data(), "dyld", 4) != 0)
+        {
+            CoreLogError("%s is not a shared cache file, skipping it", subCache.path.c_str());
+            file.reset();
+            return;
+        }
+
+        uint32_t mappingOffset = file->ReadUInt32(offsetof(dyld_cache_header, mappingOffset));
+        uint32_t mappingCount = file->ReadUInt32(offsetof(dyld_cache_header, mappingCount));
+        if ((size_t)mappingOffset + (size_t)mappingCount * sizeof(dyld_cache_mapping_info) > file->Length())
+        {
+            CoreLogError("%s has a malformed mapping table, skipping it", subCache.path.c_str());
+            file.reset();
+            return;
+        }
+
+        file->Read(subCache.uuid, offsetof(dyld_cache_header, uuid), sizeof(subCache.uuid));
+        subCache.mappings.resize(mappingCount);
+        file->Read(subCache.mappings.data(), mappingOffset, mappingCount * sizeof(dyld_cache_mapping_info));
+    });
+}
+
+
+// Registers the rebase info of every slid mapping in `file` with the VM.
+static void AddSlideInfo(VM& vm, const std::shared_ptr<MMappedFileAccessor>& file)
+{
+    dyld_cache_header header{};
+    size_t headerSize = file->ReadUInt32(offsetof(dyld_cache_header, mappingOffset));
+    file->Read(&header, 0, std::min(headerSize, sizeof(dyld_cache_header)));
+
+    std::vector<dyld_cache_mapping_and_slide_info> slidMappings;
+    if (headerSize > offsetof(dyld_cache_header, mappingWithSlideOffset))
+    {
+        if ((size_t)header.mappingWithSlideOffset + (size_t)header.mappingWithSlideCount * sizeof(dyld_cache_mapping_and_slide_info) > file->Length())
+            return;
+        slidMappings.resize(header.mappingWithSlideCount);
+        file->Read(slidMappings.data(), header.mappingWithSlideOffset, slidMappings.size() * sizeof(dyld_cache_mapping_and_slide_info));
+    }
+    else if (header.slideInfoSizeUnused && header.mappingCount > 1)
+    {
+        // Older caches only have the one slid mapping, the second (__DATA) one.
+        dyld_cache_mapping_info mapping{};
+        file->Read(&mapping, header.mappingOffset + sizeof(mapping), sizeof(mapping));
+        slidMappings.push_back({mapping.address, mapping.size, mapping.fileOffset,
+                                header.slideInfoOffsetUnused, header.slideInfoSizeUnused, 0, mapping.maxProt, mapping.initProt});
+    }
+
+    for (const auto& mapping : slidMappings)
+    {
+        if (mapping.slideInfoFileSize == 0)
+            continue;
+        try {
+            vm.AddSlideInfo(file, std::make_shared<SlideInfo>(file.get(), mapping));
+        }
+        catch (SlideInfoException& exc)
+        {
+            CoreLogWarn("Unsupported slide info for mapping at 0x%llx in %s, pointers there will be left unslid",
+                      (unsigned long long)mapping.address, file->Path().c_str());
+        }
+    }
+}
+
+
+// Read-only mappings are __LINKEDIT: tries, symbol tables and strings, all read in scattered little pieces.
+static void AdviseMapping(const MMappedFileAccessor& file, const dyld_cache_mapping_info& mapping)
+{
+    if (mapping.initProt == 1 /* VM_PROT_READ */)
+        file.Advise(mapping.fileOffset, mapping.size, MMappedFileAccessor::AdviseRandom);
+}
+
+
+// FNV-1a over the UUIDs of the subcaches that made it into the VM, so swapping any of them out changes the key.
+static uint64_t SubCacheKey(const std::vector<SubCacheFile>& subCaches)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const auto& subCache : subCaches)
+    {
+        if (!subCache.file)
+            continue;
+        for (uint8_t byte : subCache.uuid)
+        {
+            hash ^= byte;
+            hash *= 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+
+void CacheSession::MapCache()
+{
+    m_vm = std::shared_ptr<VM>(new VM(m_descriptor.pageSize));
+
+    // The base file is already open; every other file the descriptor lists is opened together.
+    std::vector<SubCacheFile> subCaches;
+    for (const auto& file : m_descriptor.files)
+    {
+        if (file.role == CacheFileDescriptor::BaseFile)
+            continue;
+        SubCacheFile subCache;
+        subCache.path = file.path;
+        subCache.optional = file.optional;
+        subCache.symbols = file.role == CacheFileDescriptor::SymbolsFile;
+        subCaches.push_back(std::move(subCache));
+    }
+    OpenSubCaches(subCaches);
+
+    for (const auto& mapping : m_descriptor.mappings)
+    {
+        m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, m_baseFile);
+        AdviseMapping(*m_baseFile, mapping);
+    }
+    AddSlideInfo(*m_vm, m_baseFile);
+
+    for (const auto& subCache : subCaches)
+    {
+        if (!subCache.file)
+            continue;
+        for (const auto& mapping : subCache.mappings)
+        {
+            m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, subCache.file);
+            AdviseMapping(*subCache.file, mapping);
+        }
+        AddSlideInfo(*m_vm, subCache.file);
+        if (subCache.symbols)
+        {
+            m_symbolsFile = subCache.file;
+            m_symbolsFile->Advise(0, m_symbolsFile->Length(), MMappedFileAccessor::AdviseRandom);
+        }
+    }
+
+    m_subCacheKey = SubCacheKey(subCaches);
+}
+
+
+void CacheSession::BuildImageTable()
+{
+    uint32_t imagesOffset = m_header.imagesOffset;
+    uint32_t imagesCount = m_header.imagesCount;
+    if (m_descriptor.format == RegularCacheFormat)
+    {
+        imagesOffset = m_header.imagesOffsetOld;
+        imagesCount = m_header.imagesCountOld;
+    }
+
+    auto data = (const char*)m_baseFile->Data();
+    size_t length = m_baseFile->Length();
+    if ((size_t)imagesOffset + (size_t)imagesCount * sizeof(dyld_cache_image_info) > length)
+    {
+        CoreLogError("Image table of %s runs past the end of the file", m_path.c_str());
+        return;
+    }
+
+    m_images.reserve(imagesCount);
+    m_imagesByInstallName.reserve(imagesCount);
+    m_imagesByBaseName.reserve(imagesCount);
+
+    dyld_cache_image_info img{};
+    for (size_t i = 0; i < imagesCount; i++)
+    {
+        memcpy(&img, data + imagesOffset + (i * sizeof(img)), sizeof(img));
+        if (img.pathFileOffset >= length)
+            continue;
+
+        std::string_view installName(data + img.pathFileOffset, strnlen(data + img.pathFileOffset, length - img.pathFileOffset));
+        m_images.push_back({installName, img.address});
+
+        size_t index = m_images.size() - 1;
+        m_imagesByInstallName.emplace(installName, index);
+        auto slash = installName.find_last_of('/');
+        m_imagesByBaseName.emplace(slash == std::string_view::npos ? installName : installName.substr(slash + 1), index);
+    }
+}
+
+
+const CacheImage* CacheSession::ImageWithInstallName(std::string_view installName) const
+{
+    auto it = m_imagesByInstallName.find(installName);
+    if (it == m_imagesByInstallName.end())
+        return nullptr;
+    return &m_images[it->second];
+}
+
+
+const CacheImage* CacheSession::ImageWithBaseName(std::string_view baseName) const
+{
+    auto it = m_imagesByBaseName.find(baseName);
+    if (it == m_imagesByBaseName.end())
+        return nullptr;
+    return &m_images[it->second];
+}
+
+
+void CacheSession::BuildAddressIndex()
+{
+    std::vector<std::vector<CacheSegment>> imageSegments(m_images.size());
+    std::vector<std::vector<CacheSection>> imageSections(m_images.size());
+
+    // Thousands of images with a dozen load commands each; the VM is read-only by now, so split the walk up.
+    ParallelFor(m_images.size(), [&](size_t i) {
+        try {
+            MachO::mach_header_64 header{};
+            m_vm->Read(&header, m_images[i].headerAddress, sizeof(header));
+
+            uint64_t cursor = m_images[i].headerAddress + sizeof(MachO::mach_header_64);
+            for (size_t j = 0; j < header.ncmds; j++)
+            {
+                uint32_t cmd = m_vm->ReadUInt32(cursor);
+                uint32_t cmdSize = m_vm->ReadUInt32(cursor + 4);
+                if (cmd == LC_SEGMENT_64)
+                {
+                    MachO::segment_command_64 seg{};
+                    m_vm->Read(&seg, cursor, sizeof(seg));
+                    CacheSegment segment{};
+                    segment.start = seg.vmaddr;
+                    segment.end = seg.vmaddr + seg.vmsize;
+                    segment.imageIndex = (uint32_t)i;
+                    segment.imageCount = 1;
+                    memcpy(segment.name, seg.segname, sizeof(segment.name));
+                    imageSegments[i].push_back(segment);
+
+                    uint64_t sectionCursor = cursor + sizeof(MachO::segment_command_64);
+                    for (size_t k = 0; k < seg.nsects; k++)
+                    {
+                        MachO::section_64 sect{};
+                        m_vm->Read(&sect, sectionCursor, sizeof(sect));
+                        CacheSection section{};
+                        section.start = sect.addr;
+                        section.end = sect.addr + sect.size;
+                        section.imageIndex = (uint32_t)i;
+                        section.imageCount = 1;
+                        memcpy(section.segmentName, sect.segname, sizeof(section.segmentName));
+                        memcpy(section.name, sect.sectname, sizeof(section.name));
+                        imageSections[i].push_back(section);
+                        sectionCursor += sizeof(MachO::section_64);
+                    }
+                }
+                if (cmdSize == 0)
+                    break;
+                cursor += cmdSize;
+            }
+        }
+        catch (MappingReadException& exc)
+        {
+            // Header isn't mapped (missing subcache); nothing to index for this image.
+        }
+    });
+
+    for (auto& segments : imageSegments)
+        m_segments.insert(m_segments.end(), segments.begin(), segments.end());
+    for (auto& sections : imageSections)
+        m_sections.insert(m_sections.end(), sections.begin(), sections.end());
+
+    auto byStart = [](const auto& a, const auto& b) {
+        if (a.start != b.start)
+            return a.start < b.start;
+        return a.imageIndex < b.imageIndex;
+    };
+    // Every image in a (sub)cache shares one __LINKEDIT; identical ranges collapse into one, counting their images.
+    auto mergeShared = [](auto& ranges) {
+        size_t kept = 0;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            if (kept && ranges[kept - 1].start == ranges[i].start && ranges[kept - 1].end == ranges[i].end)
+                ranges[kept - 1].imageCount++;
+            else
+                ranges[kept++] = ranges[i];
+        }
+        ranges.resize(kept);
+    };
+    std::stable_sort(m_segments.begin(), m_segments.end(), byStart);
+    mergeShared(m_segments);
+    std::stable_sort(m_sections.begin(), m_sections.end(), byStart);
+    mergeShared(m_sections);
+
+    // Running max of segment ends, so a lookup knows how far back an overlapping segment could still start.
+    uint64_t maxEnd = 0;
+    m_segmentsMaxEnd.reserve(m_segments.size());
+    for (const auto& segment : m_segments)
+        m_segmentsMaxEnd.push_back(maxEnd = std::max(maxEnd, segment.end));
+    BuildSectionsMaxEnd();
+}
+
+
+void CacheSession::BuildSectionsMaxEnd()
+{
+    uint64_t maxEnd = 0;
+    m_sectionsMaxEnd.clear();
+    m_sectionsMaxEnd.reserve(m_sections.size());
+    for (const auto& section : m_sections)
+        m_sectionsMaxEnd.push_back(maxEnd = std::max(maxEnd, section.end));
+}
+
+
+template <typename T>
+static const T* RangeAt(const std::vector<T>& ranges, const std::vector<uint64_t>& maxEnd, uint64_t address)
+{
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), address, [](uint64_t address, const T& range) {
+        return address < range.start;
+    });
+    for (size_t i = it - ranges.begin(); i > 0 && maxEnd[i - 1] > address; i--)
+    {
+        if (ranges[i - 1].end > address)
+            return &ranges[i - 1];
+    }
+    return nullptr;
+}
+
+
+const CacheSegment* CacheSession::SegmentAt(uint64_t address)
+{
+    std::call_once(m_addressIndexOnce, [this]() { BuildAddressIndex(); });
+    return RangeAt(m_segments, m_segmentsMaxEnd, address);
+}
+
+
+const CacheSection* CacheSession::SectionAt(uint64_t address)
+{
+    std::call_once(m_addressIndexOnce, [this]() { BuildAddressIndex(); });
+    return RangeAt(m_sections, m_sectionsMaxEnd, address);
+}
+
+
+const CacheSection* CacheSession::SectionNamed(size_t imageIndex, std::string_view segmentName, std::string_view name)
+{
+    std::call_once(m_addressIndexOnce, [this]() { BuildAddressIndex(); });
+    for (const auto& section : m_sections)
+    {
+        if (section.imageIndex == imageIndex
+            && std::string_view(section.segmentName, strnlen(section.segmentName, 16)) == segmentName
+            && std::string_view(section.name, strnlen(section.name, 16)) == name)
+            return &section;
+    }
+    return nullptr;
+}
+
+
+const ObjCOptimizations* CacheSession::GetObjCOptimizations()
+{
+    std::call_once(m_objcOptimizationsOnce, [this]() { m_objcOptimizations = ObjCOptimizations::Load(*this); });
+    return m_objcOptimizations.get();
+}
+
+
+IndexCacheKey CacheSession::IndexKey() const
+{
+    IndexCacheKey key{};
+    memcpy(key.cacheUUID, m_header.uuid, sizeof(key.cacheUUID));
+    key.subCacheKey = m_subCacheKey;
+    key.imageCount = (uint32_t)m_images.size();
+    return key;
+}
+
+
+// Whether ranges read back from an index file are what BuildAddressIndex would have produced for this cache.
+template <typename T>
+static bool ValidRanges(const T* ranges, size_t count, size_t imageCount)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ranges[i].start > ranges[i].end || ranges[i].imageIndex >= imageCount || ranges[i].imageCount == 0
+            || (i && ranges[i - 1].start > ranges[i].start))
+            return false;
+    }
+    return true;
+}
+
+
+void CacheSession::LoadIndexCache()
+{
+    auto path = IndexCacheFile::PathForCache(m_uuid);
+    if (path.empty())
+        return;
+    auto file = IndexCacheFile::Open(path, IndexKey());
+    if (!file)
+        return;
+
+    const CacheSegment* segments;
+    const CacheSection* sections;
+    const uint64_t* segmentsMaxEnd;
+    size_t segmentCount, sectionCount, segmentsMaxEndCount;
+    if (file->Section(SegmentsSection, segments, segmentCount)
+        && file->Section(SegmentsMaxEndSection, segmentsMaxEnd, segmentsMaxEndCount)
+        && file->Section(SectionsSection, sections, sectionCount)
+        && segmentCount == segmentsMaxEndCount
+        && ValidRanges(segments, segmentCount, m_images.size())
+        && ValidRanges(sections, sectionCount, m_images.size()))
+    {
+        // The running maxima have to agree with the segments too, or lookups would stop early.
+        uint64_t maxEnd = 0;
+        bool valid = true;
+        for (size_t i = 0; i < segmentCount && valid; i++)
+            valid = segmentsMaxEnd[i] == (maxEnd = std::max(maxEnd, segments[i].end));
+
+        // A few thousand entries; copying them out is cheaper than teaching every lookup about the mapping.
+        // Anything that doesn't check out is left for BuildAddressIndex to redo on first lookup.
+        if (valid)
+        {
+            std::call_once(m_addressIndexOnce, [&]() {
+                m_segments.assign(segments, segments + segmentCount);
+                m_segmentsMaxEnd.assign(segmentsMaxEnd, segmentsMaxEnd + segmentCount);
+                m_sections.assign(sections, sections + sectionCount);
+                BuildSectionsMaxEnd();
+            });
+        }
+    }
+
+    if (auto index = SymbolIndex::Load(*this, *file))
+    {
+        std::call_once(m_symbolIndexOnce, [&]() {
+            std::promise<std::shared_ptr<SymbolIndex>> loaded;
+            loaded.set_value(index);
+            m_symbolIndex = loaded.get_future().share();
+        });
+    }
+}
+
+
+void CacheSession::SaveIndexCache(const SymbolIndex& symbols)
+{
+    auto path = IndexCacheFile::PathForCache(m_uuid);
+    if (path.empty())
+        return;
+
+    std::call_once(m_addressIndexOnce, [this]() { BuildAddressIndex(); });
+
+    IndexCacheWriter writer;
+    writer.AddSection(SegmentsSection, m_segments);
+    writer.AddSection(SegmentsMaxEndSection, m_segmentsMaxEnd);
+    writer.AddSection(SectionsSection, m_sections);
+    symbols.Save(writer);
+
+    if (!writer.Write(path, IndexKey()))
+        CoreLogWarn("Couldn't write the index cache for %s to %s", m_path.c_str(), path.c_str());
+}
+
+
+CacheSession::~CacheSession()
+{
+    m_symbolIndexCancelled = true;
+}
+
+
+void CacheSession::BuildSymbolIndexInBackground()
+{
+    std::call_once(m_symbolIndexOnce, [this]() {
+        m_symbolIndex = std::async(std::launch::async, [this]() -> std::shared_ptr<SymbolIndex> {
+            try {
+                auto index = SymbolIndex::Build(*this, m_symbolIndexCancelled);
+                if (index)
+                    SaveIndexCache(*index);
+                return index;
+            }
+            catch (std::exception& exc)
+            {
+                CoreLogError("Failed to build the symbol index of %s: %s", m_path.c_str(), exc.what());
+                return nullptr;
+            }
+        }).share();
+    });
+}
+
+
+std::shared_ptr<SymbolIndex> CacheSession::GetSymbolIndex()
+{
+    BuildSymbolIndexInBackground();
+    return m_symbolIndex.get();
+}
+
+
+std::shared_ptr<CacheSession> CacheSession::Acquire(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(s_sessionsMutex);
+
+    // Callers almost always already have a live session for this path, so check before touching the disk.
+    for (auto it = s_sessions.begin(); it != s_sessions.end();)
+    {
+        auto session = it->second.lock();
+        if (!session)
+        {
+            it = s_sessions.erase(it);
+            continue;
+        }
+        if (session->m_path == path)
+            return session;
+        ++it;
+    }
+
+    std::shared_ptr<MMappedFileAccessor> baseFile;
+    try {
+        std::string filePath = path;
+        baseFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(filePath));
+    }
+    catch (MissingFileException& exc)
+    {
+        return nullptr;
+    }
+
+    if (baseFile->Length() < 0x20 || strncmp((const char*)baseFile->Data(), "dyld", 4) != 0)
+        return nullptr;
+
+    auto session = std::shared_ptr<CacheSession>(new CacheSession(baseFile));
+
+    // Same cache opened through a different path (symlink, copy); share the mapping we already have.
+    if (auto existing = s_sessions[session->m_uuid].lock())
+        return existing;
+
+    try {
+        session->MapCache();
+    }
+    catch (std::exception& exc)
+    {
+        // Overlapping or misaligned mappings; a malformed cache shouldn't take its caller down with it.
+        CoreLogError("Couldn't map %s: %s", path.c_str(), exc.what());
+        return nullptr;
+    }
+    session->LoadIndexCache();
+    s_sessions[session->m_uuid] = session;
+    return session;
+}
@@ -0,0 +1,158 @@
+#ifndef KSUITE_CACHESESSION_H
+#define KSUITE_CACHESESSION_H
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "VM.h"
+#include "CacheHeader.h"
+#include "CacheDescriptor.h"
+#include "StringTable.h"
+#include "ObjCOptimizations.h"
+#include "SymbolIndex.h"
+#include "IndexCache.h"
+
+
+struct CacheImage {
+    // Points into the mapped base file; valid for as long as the session is.
+    std::string_view installName;
+    uint64_t headerAddress;
+};
+
+
+/*
+ * Ranges described by more than one image's load commands (every image in a subcache names the same __LINKEDIT)
+ *  appear once, with imageCount > 1. imageIndex is then just the first of them, so callers needing the owner of an
+ *  address must check imageCount first.
+ */
+struct CacheSegment {
+    uint64_t start;
+    uint64_t end;
+    uint32_t imageIndex;
+    uint32_t imageCount;
+    char name[16];
+};
+
+
+struct CacheSection {
+    uint64_t start;
+    uint64_t end;
+    uint32_t imageIndex;
+    uint32_t imageCount;
+    char segmentName[16];
+    char name[16];
+};
+
+
+/*
+ * Everything we get from a shared cache on disk: the base file, every subcache, and the VM built over them.
+ *
+ * Mapping a modern cache means opening and mapping a couple dozen files, so we do it once per cache
+ *  and hand out the same session to anyone asking for it. Sessions are keyed by the UUID in the base header,
+ *  and live for as long as somebody (normally the DSCView) holds a reference.
+ */
+class CacheSession {
+    std::string m_path;
+    std::string m_uuid;
+    dyld_cache_header m_header {};
+    CacheDescriptor m_descriptor;
+
+    std::shared_ptr<MMappedFileAccessor> m_baseFile;
+    // Split caches' unmapped local symbols; nullptr if the cache has no .symbols file.
+    std::shared_ptr<MMappedFileAccessor> m_symbolsFile;
+    std::shared_ptr<VM> m_vm;
+    // Identifies the exact set of subcaches mapped, for the index cache file.
+    uint64_t m_subCacheKey = 0;
+
+    /* IMAGE TABLE START */
+    std::vector<CacheImage> m_images;
+    std::unordered_map<std::string_view, size_t> m_imagesByInstallName;
+    std::unordered_map<std::string_view, size_t> m_imagesByBaseName;
+    /* IMAGE TABLE END */
+
+    /* ADDRESS INDEX START */
+    // Every image segment and section, sorted by start address. Built on first lookup.
+    std::once_flag m_addressIndexOnce;
+    std::vector<CacheSegment> m_segments;
+    std::vector<uint64_t> m_segmentsMaxEnd;
+    std::vector<CacheSection> m_sections;
+    // Not saved to the sidecar; it's recomputed from m_sections in one pass.
+    std::vector<uint64_t> m_sectionsMaxEnd;
+    /* ADDRESS INDEX END */
+
+    // Selectors, class names, type encodings, etc. Shared by everything loading images from this cache.
+    StringTable m_strings;
+
+    std::once_flag m_objcOptimizationsOnce;
+    std::unique_ptr<ObjCOptimizations> m_objcOptimizations;
+
+    // Set on destruction, so a build still running gives up instead of finishing an index nobody will use.
+    std::atomic<bool> m_symbolIndexCancelled {false};
+    // Declared last so it's destroyed first: that waits out a build still running against this session.
+    std::once_flag m_symbolIndexOnce;
+    std::shared_future<std::shared_ptr<SymbolIndex>> m_symbolIndex;
+
+    static std::mutex s_sessionsMutex;
+    static std::map<std::string, std::weak_ptr<CacheSession>> s_sessions;
+
+    explicit CacheSession(std::shared_ptr<MMappedFileAccessor> baseFile);
+
+    void MapCache();
+    void BuildImageTable();
+    void BuildAddressIndex();
+    void BuildSectionsMaxEnd();
+
+    /*
+     * The address and symbol indexes are kept in a sidecar file in the user directory, keyed by cache and subcache
+     *  UUIDs. Loading it pre-fills both (the symbol index is used from the mapping in place); a fresh build writes it.
+     */
+    IndexCacheKey IndexKey() const;
+    void LoadIndexCache();
+    void SaveIndexCache(const SymbolIndex& symbols);
+
+public:
+    /*
+     * Returns the live session for the cache at `path`, creating and mapping it if nobody holds one.
+     * Returns nullptr if the file is missing or isn't a shared cache.
+     */
+    static std::shared_ptr<CacheSession> Acquire(const std::string& path);
+    ~CacheSession();
+
+    const std::string& Path() const { return m_path; };
+    const std::string& UUID() const { return m_uuid; };
+    const dyld_cache_header& Header() const { return m_header; };
+    SharedCacheFormat Format() const { return m_descriptor.format; };
+    const CacheDescriptor& Descriptor() const { return m_descriptor; };
+
+    std::shared_ptr<MMappedFileAccessor> BaseFile() const { return m_baseFile; };
+    std::shared_ptr<MMappedFileAccessor> LocalSymbolsFile() const { return m_symbolsFile; };
+    std::shared_ptr<VM> GetVM() const { return m_vm; };
+
+    StringTable& Strings() { return m_strings; };
+
+    const std::vector<CacheImage>& Images() const { return m_images; };
+    const CacheImage* ImageWithInstallName(std::string_view installName) const;
+    const CacheImage* ImageWithBaseName(std::string_view baseName) const;
+
+    // Image segment/section containing `address`, or nullptr. Use imageIndex to get at the image, unless it's shared.
+    const CacheSegment* SegmentAt(uint64_t address);
+    const CacheSection* SectionAt(uint64_t address);
+    const CacheSection* SectionNamed(size_t imageIndex, std::string_view segmentName, std::string_view name);
+
+    // The cache's prebuilt ObjC selector/class/protocol tables, read on first use. nullptr if it has none.
+    const ObjCOptimizations* GetObjCOptimizations();
+
+    /*
+     * Every export and local symbol in the cache. The first call (normally from DSCView::Init) starts building it
+     *  on a background thread; GetSymbolIndex waits for that to finish. nullptr if building it failed.
+     */
+    void BuildSymbolIndexInBackground();
+    std::shared_ptr<SymbolIndex> GetSymbolIndex();
+};
+
+
+#endif //KSUITE_CACHESESSION_H
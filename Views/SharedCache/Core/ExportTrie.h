@@ -0,0 +1,117 @@
+#ifndef KSUITE_EXPORTTRIE_H
+#define KSUITE_EXPORTTRIE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+class ExportTrieException : public std::exception {
+    virtual const char *what() const throw() {
+        return "Malformed export trie";
+    }
+};
+
+
+namespace ExportTrie {
+
+    // Decodes a ULEB128 at `cursor`, advancing it. Throws ExportTrieException if it runs past `end` or overflows.
+    inline uint64_t ReadULEB128(const uint8_t* data, size_t end, size_t& cursor)
+    {
+        uint64_t result = 0;
+        int bit = 0;
+        uint8_t byte;
+        do {
+            if (cursor >= end || bit > 63)
+                throw ExportTrieException();
+            byte = data[cursor++];
+            result |= (uint64_t)(byte & 0x7f) << bit;
+            bit += 7;
+        } while (byte & 0x80);
+        return result;
+    }
+
+    // EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE exports carry the value itself, not an offset into the image.
+    inline uint64_t ExportAddress(uint64_t imageBase, uint64_t flags, uint64_t value)
+    {
+        return (flags & 0x3) == 0x2 ? value : imageBase + value;
+    }
+
+    /*
+     * Walks the export trie in data[0, size) and calls visit(name, flags, imageOffset) for every terminal,
+     *  re-exports excluded.
+     *
+     * Iterative, with an explicit stack and one shared prefix buffer, so there's no per-node allocation.
+     * `name` is only valid for the duration of the call.
+     */
+    template <typename Visitor>
+    void ForEachExport(const uint8_t* data, size_t size, Visitor&& visit)
+    {
+        struct Pending {
+            size_t node;         // offset of the node in the trie
+            size_t prefixLength; // length of the parent's name
+            size_t label;        // offset of the edge label leading here
+            size_t labelLength;
+        };
+
+        if (!data || size == 0)
+            return;
+
+        std::string name;
+        name.reserve(256);
+        std::vector<Pending> stack;
+        stack.reserve(64);
+        stack.push_back({0, 0, 0, 0});
+
+        // A well formed trie visits each node once; anything more means a cycle.
+        size_t budget = size;
+        while (!stack.empty())
+        {
+            if (budget-- == 0)
+                throw ExportTrieException();
+
+            Pending pending = stack.back();
+            stack.pop_back();
+
+            name.resize(pending.prefixLength);
+            name.append((const char*)data + pending.label, pending.labelLength);
+
+            size_t cursor = pending.node;
+            uint64_t terminalSize = ReadULEB128(data, size, cursor);
+            size_t childrenStart = cursor + terminalSize;
+            if (childrenStart >= size)
+                throw ExportTrieException();
+
+            if (terminalSize != 0)
+            {
+                uint64_t flags = ReadULEB128(data, size, cursor);
+                if (!(flags & 0x08)) // EXPORT_SYMBOL_FLAGS_REEXPORT
+                {
+                    uint64_t imageOffset = ReadULEB128(data, size, cursor);
+                    visit(name, flags, imageOffset);
+                }
+            }
+
+            cursor = childrenStart;
+            uint8_t childCount = data[cursor++];
+            for (uint8_t i = 0; i < childCount; i++)
+            {
+                size_t label = cursor;
+                while (cursor < size && data[cursor] != 0)
+                    cursor++;
+                if (cursor >= size)
+                    throw ExportTrieException();
+                size_t labelLength = cursor - label;
+                cursor++;
+
+                uint64_t next = ReadULEB128(data, size, cursor);
+                if (next == 0 || next >= size)
+                    throw ExportTrieException();
+                stack.push_back({(size_t)next, name.size(), label, labelLength});
+            }
+        }
+    }
+}
+
+
+#endif //KSUITE_EXPORTTRIE_H
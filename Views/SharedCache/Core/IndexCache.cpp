@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include "IndexCache.h"
+#include "VM.h"
+
+
+// Bump whenever anything written here, or any struct dumped into a section, changes meaning.
+static constexpr uint32_t IndexCacheVersion = 2;
+static constexpr char IndexCacheMagic[8] = {'K', 'S', 'D', 'S', 'C', 'I', 'D', 'X'};
+static constexpr uint32_t IndexCacheByteOrder = 0x01020304;
+
+
+static uint64_t AlignSection(uint64_t offset)
+{
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+
+static std::string s_directory;
+
+
+void IndexCacheFile::SetDirectory(const std::string& directory)
+{
+    s_directory = directory;
+}
+
+
+std::string IndexCacheFile::PathForCache(const std::string& uuid)
+{
+    if (s_directory.empty())
+        return "";
+    return s_directory + "/" + uuid + ".idx";
+}
+
+
+std::shared_ptr<IndexCacheFile> IndexCacheFile::Open(const std::string& path, const IndexCacheKey& key)
+{
+    std::shared_ptr<MMappedFileAccessor> file;
+    try {
+        std::string filePath = path;
+        file = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(filePath));
+    }
+    catch (MissingFileException& exc)
+    {
+        return nullptr;
+    }
+
+    IndexCacheHeader header{};
+    if (file->Length() < sizeof(header))
+        return nullptr;
+    memcpy(&header, file->Data(), sizeof(header));
+    if (memcmp(header.magic, IndexCacheMagic, sizeof(header.magic)) != 0
+        || header.version != IndexCacheVersion
+        || header.byteOrder != IndexCacheByteOrder
+        || memcmp(header.cacheUUID, key.cacheUUID, sizeof(header.cacheUUID)) != 0
+        || header.subCacheKey != key.subCacheKey
+        || header.imageCount != key.imageCount)
+        return nullptr;
+
+    if (sizeof(header) + (uint64_t)header.sectionCount * sizeof(IndexCacheSectionEntry) > file->Length())
+        return nullptr;
+
+    auto index = std::make_shared<IndexCacheFile>();
+    index->m_sections.resize(header.sectionCount);
+    memcpy(index->m_sections.data(), (const uint8_t*)file->Data() + sizeof(header),
+           header.sectionCount * sizeof(IndexCacheSectionEntry));
+    for (const auto& section : index->m_sections)
+    {
+        if (section.offset > file->Length() || section.size > file->Length() - section.offset
+            || section.offset % 16 != 0)
+            return nullptr;
+    }
+
+    index->m_file = file;
+    return index;
+}
+
+
+bool IndexCacheFile::Section(IndexCacheSectionKind kind, size_t elementSize, const void*& data, size_t& count) const
+{
+    for (const auto& section : m_sections)
+    {
+        if (section.kind != kind)
+            continue;
+        if (section.elementSize != elementSize || section.size % elementSize != 0)
+            return false;
+        data = (const uint8_t*)m_file->Data() + section.offset;
+        count = section.size / elementSize;
+        return true;
+    }
+    return false;
+}
+
+
+void IndexCacheWriter::AddSection(IndexCacheSectionKind kind, size_t elementSize, const void* data, size_t count)
+{
+    m_sections.push_back({{kind, (uint32_t)elementSize, 0, (uint64_t)(elementSize * count)}, data});
+}
+
+
+bool IndexCacheWriter::Write(const std::string& path, const IndexCacheKey& key) const
+{
+    IndexCacheHeader header{};
+    memcpy(header.magic, IndexCacheMagic, sizeof(header.magic));
+    header.version = IndexCacheVersion;
+    header.byteOrder = IndexCacheByteOrder;
+    memcpy(header.cacheUUID, key.cacheUUID, sizeof(header.cacheUUID));
+    header.subCacheKey = key.subCacheKey;
+    header.imageCount = key.imageCount;
+    header.sectionCount = (uint32_t)m_sections.size();
+
+    std::vector<IndexCacheSectionEntry> entries;
+    uint64_t offset = AlignSection(sizeof(header) + m_sections.size() * sizeof(IndexCacheSectionEntry));
+    for (const auto& section : m_sections)
+    {
+        auto entry = section.entry;
+        entry.offset = offset;
+        entries.push_back(entry);
+        offset = AlignSection(offset + entry.size);
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Several processes may open the same cache at once; give each its own temporary file.
+    auto tempPath = path + "." + std::to_string(std::random_device()()) + ".tmp";
+    FILE* out = fopen(tempPath.c_str(), "wb");
+    if (!out)
+        return false;
+
+    static const uint8_t padding[16] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!entries.empty())
+        ok = ok && fwrite(entries.data(), sizeof(IndexCacheSectionEntry), entries.size(), out) == entries.size();
+    uint64_t written = sizeof(header) + entries.size() * sizeof(IndexCacheSectionEntry);
+    for (size_t i = 0; ok && i < m_sections.size(); i++)
+    {
+        ok = fwrite(padding, 1, entries[i].offset - written, out) == entries[i].offset - written;
+        if (entries[i].size)
+            ok = ok && fwrite(m_sections[i].data, entries[i].size, 1, out) == 1;
+        written = entries[i].offset + entries[i].size;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (ok)
+        std::filesystem::rename(tempPath, path, error);
+    if (!ok || error)
+    {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
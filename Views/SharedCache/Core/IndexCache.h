@@ -0,0 +1,112 @@
+#ifndef KSUITE_INDEXCACHE_H
+#define KSUITE_INDEXCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MMappedFileAccessor;
+
+
+/*
+ * Sidecar file holding the indexes we build over a cache, so reopening the same cache doesn't rebuild them.
+ *
+ * Layout (little endian, every section 16 byte aligned):
+ *   IndexCacheHeader
+ *   IndexCacheSectionEntry[sectionCount]
+ *   section data
+ *
+ * A file is only used if its version, cache UUID and subcache key all match; anything else is rebuilt and
+ *  overwritten. Sections are arrays of plain structs and are used straight out of the mapping where possible.
+ */
+
+enum IndexCacheSectionKind : uint32_t {
+    SegmentsSection = 1,      // CacheSegment[]
+    SegmentsMaxEndSection,    // uint64_t[]
+    SectionsSection,          // CacheSection[]
+    SymbolEntriesSection,     // SymbolIndex::Entry[]
+    SymbolsByNameSection,     // uint32_t[]
+    SymbolNamesSection,       // NUL separated names
+};
+
+struct IndexCacheHeader {
+    char magic[8];            // "KSDSCIDX"
+    uint32_t version;
+    uint32_t byteOrder;       // 0x01020304 as written by the host that built it
+    uint8_t cacheUUID[16];
+    uint64_t subCacheKey;     // hash over the UUIDs of every subcache that was mapped
+    uint32_t imageCount;
+    uint32_t sectionCount;
+};
+
+struct IndexCacheSectionEntry {
+    uint32_t kind;
+    uint32_t elementSize;     // sizeof the element type when written; a mismatch means the layout changed
+    uint64_t offset;
+    uint64_t size;
+};
+
+
+struct IndexCacheKey {
+    uint8_t cacheUUID[16];
+    uint64_t subCacheKey;
+    uint32_t imageCount;
+};
+
+
+class IndexCacheFile {
+    std::shared_ptr<MMappedFileAccessor> m_file;
+    std::vector<IndexCacheSectionEntry> m_sections;
+
+public:
+    // Where sidecars are kept. Until a host sets one, nothing is read or written.
+    static void SetDirectory(const std::string& directory);
+
+    // Where the sidecar for a cache with this UUID lives; empty if there's no directory set.
+    static std::string PathForCache(const std::string& uuid);
+
+    // Maps and validates the sidecar at `path`. nullptr if it's missing, damaged, or for a different cache.
+    static std::shared_ptr<IndexCacheFile> Open(const std::string& path, const IndexCacheKey& key);
+
+    // The data of section `kind` as an array of `elementSize` byte elements; false if absent or of another layout.
+    bool Section(IndexCacheSectionKind kind, size_t elementSize, const void*& data, size_t& count) const;
+
+    template <typename T>
+    bool Section(IndexCacheSectionKind kind, const T*& data, size_t& count) const
+    {
+        const void* raw;
+        if (!Section(kind, sizeof(T), raw, count))
+            return false;
+        data = (const T*)raw;
+        return true;
+    }
+
+    // Keeps the mapping alive for whoever still points into it.
+    std::shared_ptr<MMappedFileAccessor> File() const { return m_file; };
+};
+
+
+class IndexCacheWriter {
+    struct PendingSection {
+        IndexCacheSectionEntry entry;
+        const void* data;
+    };
+    std::vector<PendingSection> m_sections;
+
+public:
+    // `data` has to stay valid until Write returns.
+    void AddSection(IndexCacheSectionKind kind, size_t elementSize, const void* data, size_t count);
+
+    template <typename T>
+    void AddSection(IndexCacheSectionKind kind, const std::vector<T>& values)
+    {
+        AddSection(kind, sizeof(T), values.data(), values.size());
+    }
+
+    // Writes to a temporary file next to `path` and renames it over, so readers never see a partial file.
+    bool Write(const std::string& path, const IndexCacheKey& key) const;
+};
+
+
+#endif //KSUITE_INDEXCACHE_H
@@ -0,0 +1,62 @@
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include "Log.h"
+
+
+static void StderrSink(CoreLogLevel level, const char* message)
+{
+    static const char* prefixes[] = {"info", "warning", "error"};
+    fprintf(stderr, "[sharedcache] %s: %s\n", prefixes[level], message);
+}
+
+
+static CoreLogSink s_sink = StderrSink;
+
+
+void SetCoreLogSink(CoreLogSink sink)
+{
+    s_sink = sink ? sink : StderrSink;
+}
+
+
+static void Log(CoreLogLevel level, const char* fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(nullptr, 0, fmt, copy);
+    va_end(copy);
+    if (length < 0)
+        return;
+
+    std::string message(length, '\0');
+    vsnprintf(message.data(), message.size() + 1, fmt, args);
+    s_sink(level, message.c_str());
+}
+
+
+void CoreLogInfo(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Log(CoreInfoLog, fmt, args);
+    va_end(args);
+}
+
+
+void CoreLogWarn(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Log(CoreWarningLog, fmt, args);
+    va_end(args);
+}
+
+
+void CoreLogError(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Log(CoreErrorLog, fmt, args);
+    va_end(args);
+}
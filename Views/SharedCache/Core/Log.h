@@ -0,0 +1,26 @@
+#ifndef KSUITE_CORE_LOG_H
+#define KSUITE_CORE_LOG_H
+
+/*
+ * Logging for the core, which can't call into Binary Ninja.
+ *
+ * Messages go to stderr until a host installs a sink; the plugin forwards them to the Binary Ninja log.
+ */
+
+enum CoreLogLevel {
+    CoreInfoLog,
+    CoreWarningLog,
+    CoreErrorLog,
+};
+
+typedef void (*CoreLogSink)(CoreLogLevel level, const char* message);
+
+// Not thread safe against logging in flight; set it once at startup.
+void SetCoreLogSink(CoreLogSink sink);
+
+void CoreLogInfo(const char* fmt, ...);
+void CoreLogWarn(const char* fmt, ...);
+void CoreLogError(const char* fmt, ...);
+
+
+#endif //KSUITE_CORE_LOG_H
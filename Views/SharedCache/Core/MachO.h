@@ -0,0 +1,113 @@
+#ifndef KSUITE_CORE_MACHO_H
+#define KSUITE_CORE_MACHO_H
+
+#include <cstdint>
+
+/*
+ * The few Mach-O structures and constants the core reads out of cache images, so it doesn't need the Mach-O view.
+ *
+ * Layouts match <mach-o/loader.h> and <mach-o/nlist.h>. Only include this from core sources; the plugin gets the
+ *  same names from the Mach-O view's header.
+ */
+
+#ifndef LC_SEGMENT_64
+#define LC_SEGMENT_64 0x19
+#endif
+#ifndef LC_UUID
+#define LC_UUID 0x1b
+#endif
+#ifndef LC_DYLD_INFO
+#define LC_DYLD_INFO 0x22
+#endif
+#ifndef LC_DYLD_INFO_ONLY
+#define LC_DYLD_INFO_ONLY 0x80000022
+#endif
+#ifndef LC_DYLD_EXPORTS_TRIE
+#define LC_DYLD_EXPORTS_TRIE 0x80000033
+#endif
+
+#ifndef N_STAB
+#define N_STAB 0xe0
+#endif
+#ifndef N_TYPE
+#define N_TYPE 0x0e
+#endif
+#ifndef N_SECT
+#define N_SECT 0x0e
+#endif
+
+
+namespace MachO {
+    struct mach_header_64 {
+        uint32_t magic;
+        int32_t cputype;
+        int32_t cpusubtype;
+        uint32_t filetype;
+        uint32_t ncmds;
+        uint32_t sizeofcmds;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    struct segment_command_64 {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        char segname[16];
+        uint64_t vmaddr;
+        uint64_t vmsize;
+        uint64_t fileoff;
+        uint64_t filesize;
+        uint32_t maxprot;
+        uint32_t initprot;
+        uint32_t nsects;
+        uint32_t flags;
+    };
+
+    struct section_64 {
+        char sectname[16];
+        char segname[16];
+        uint64_t addr;
+        uint64_t size;
+        uint32_t offset;
+        uint32_t align;
+        uint32_t reloff;
+        uint32_t nreloc;
+        uint32_t flags;
+        uint32_t reserved1;
+        uint32_t reserved2;
+        uint32_t reserved3;
+    };
+
+    struct dyld_info_command {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t rebase_off;
+        uint32_t rebase_size;
+        uint32_t bind_off;
+        uint32_t bind_size;
+        uint32_t weak_bind_off;
+        uint32_t weak_bind_size;
+        uint32_t lazy_bind_off;
+        uint32_t lazy_bind_size;
+        uint32_t export_off;
+        uint32_t export_size;
+    };
+
+    struct linkedit_data_command {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t dataoff;
+        uint32_t datasize;
+    };
+
+    struct nlist_64 {
+        uint32_t n_strx;
+        uint8_t n_type;
+        uint8_t n_sect;
+        uint16_t n_desc;
+        uint64_t n_value;
+    };
+}
+
+
+#endif //KSUITE_CORE_MACHO_H
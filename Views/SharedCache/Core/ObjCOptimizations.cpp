@@ -0,0 +1,395 @@
+#include <cstring>
+#include "ObjCOptimizations.h"
+#include "CacheSession.h"
+
+
+namespace {
+    // dyld4's ObjCOptimizationHeader, found at cache base + dyld_cache_header::objcOptsOffset.
+    struct __attribute__((packed)) ObjCOptimizationHeader {
+        uint32_t version;
+        uint32_t flags;
+        uint64_t headerInfoROCacheOffset;
+        uint64_t headerInfoRWCacheOffset;
+        uint64_t selectorHashTableCacheOffset;
+        uint64_t classHashTableCacheOffset;
+        uint64_t protocolHashTableCacheOffset;
+        uint64_t relativeMethodSelectorBaseAddressOffset;
+    };
+
+    // capacity, occupied, shift, mask, zero/sentinelTarget, unused/roundedTabSize, salt, scramble[256]
+    constexpr size_t HashTableHeaderSize = 6 * 4 + 8 + 256 * 4;
+    constexpr size_t ObjectEntrySize = 8;
+    constexpr uint64_t ObjectOffsetMask = (1ULL << 47) - 1;
+}
+
+
+// Bob Jenkins' lookup8, the hash every objc/dyld perfect hash table is built with.
+#define mix64(a, b, c) \
+{ \
+    a -= b; a -= c; a ^= (c >> 43); \
+    b -= c; b -= a; b ^= (a << 9); \
+    c -= a; c -= b; c ^= (b >> 8); \
+    a -= b; a -= c; a ^= (c >> 38); \
+    b -= c; b -= a; b ^= (a << 23); \
+    c -= a; c -= b; c ^= (b >> 5); \
+    a -= b; a -= c; a ^= (c >> 35); \
+    b -= c; b -= a; b ^= (a << 49); \
+    c -= a; c -= b; c ^= (b >> 11); \
+    a -= b; a -= c; a ^= (c >> 12); \
+    b -= c; b -= a; b ^= (a << 18); \
+    c -= a; c -= b; c ^= (b >> 22); \
+}
+
+static uint64_t lookup8(const uint8_t* k, size_t length, uint64_t level)
+{
+    uint64_t a = level, b = level, c = 0x9e3779b97f4a7c13ULL;
+    size_t len = length;
+
+    auto load64 = [](const uint8_t* p) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--)
+            value = (value << 8) | p[i];
+        return value;
+    };
+
+    while (len >= 24)
+    {
+        a += load64(k);
+        b += load64(k + 8);
+        c += load64(k + 16);
+        mix64(a, b, c);
+        k += 24;
+        len -= 24;
+    }
+
+    c += length;
+    // The low byte of c is taken by the length, so its tail bytes start one byte up.
+    for (size_t i = len; i > 16; i--)
+        c += (uint64_t)k[i - 1] << ((i - 16) * 8);
+    for (size_t i = std::min<size_t>(len, 16); i > 8; i--)
+        b += (uint64_t)k[i - 1] << ((i - 9) * 8);
+    for (size_t i = std::min<size_t>(len, 8); i > 0; i--)
+        a += (uint64_t)k[i - 1] << ((i - 1) * 8);
+    mix64(a, b, c);
+
+    return c;
+}
+
+#undef mix64
+
+
+bool ObjCHashTable::Bind(VM& vm, size_t size)
+{
+    // Tables live in read-only __TEXT, so they're almost always contiguous in one mapping; use them in place.
+    size_t available = 0;
+    if (auto data = vm.ResolveAddress(m_address, &available); data && available >= size)
+    {
+        m_data = data;
+        m_size = size;
+        return true;
+    }
+
+    try {
+        m_owned.resize(size);
+        vm.Read(m_owned.data(), m_address, size);
+    }
+    catch (MappingReadException& exc)
+    {
+        m_owned.clear();
+        m_data = nullptr;
+        return false;
+    }
+    m_data = m_owned.data();
+    m_size = size;
+    return true;
+}
+
+
+uint32_t ObjCHashTable::Read32(size_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, m_data + offset, sizeof(value));
+    return value;
+}
+
+
+uint64_t ObjCHashTable::Read64(size_t offset) const
+{
+    uint64_t value;
+    memcpy(&value, m_data + offset, sizeof(value));
+    return value;
+}
+
+
+bool ObjCHashTable::Load(VM& vm, uint64_t address, Layout layout, bool hasObjects)
+{
+    m_address = address;
+    m_layout = layout;
+    if (!Bind(vm, HashTableHeaderSize))
+        return false;
+
+    m_capacity = Read32(0);
+    m_shift = Read32(8);
+    m_mask = Read32(12);
+    m_sentinel = Read32(16);
+    m_salt = Read64(24);
+    size_t tabSize = layout == LegacyLayout ? (size_t)m_mask + 1 : Read32(20);
+
+    // Anything outside of this isn't a hash table, and would have us reading off into the weeds.
+    if (m_capacity == 0 || m_capacity > (1 << 24) || m_mask >= (1 << 24) || (m_mask & (m_mask + 1)) != 0
+        || m_shift >= 64 || tabSize < (size_t)m_mask + 1 || tabSize > (1 << 25))
+    {
+        m_data = nullptr;
+        return false;
+    }
+
+    m_tabOffset = HashTableHeaderSize;
+    m_checkBytesOffset = m_tabOffset + tabSize;
+    m_offsetsOffset = m_checkBytesOffset + m_capacity;
+    size_t size = m_offsetsOffset + (size_t)m_capacity * 4;
+
+    if (hasObjects)
+    {
+        m_objectsOffset = size;
+        size = m_objectsOffset + (size_t)m_capacity * ObjectEntrySize;
+        if (!Bind(vm, size + 4))
+            return false;
+        m_duplicateCount = Read32(size);
+        if (m_duplicateCount > (1 << 24))
+        {
+            m_data = nullptr;
+            return false;
+        }
+        m_duplicatesOffset = size + 4;
+        size = m_duplicatesOffset + (size_t)m_duplicateCount * ObjectEntrySize;
+    }
+
+    return Bind(vm, size);
+}
+
+
+std::optional<uint32_t> ObjCHashTable::Find(VM& vm, std::string_view key) const
+{
+    if (!m_data || key.empty())
+        return std::nullopt;
+
+    uint64_t val = lookup8((const uint8_t*)key.data(), key.size(), m_salt);
+    uint32_t index = (uint32_t)(val >> m_shift) ^ Read32(32 + 4 * (size_t)m_data[m_tabOffset + (val & m_mask)]);
+    if (index >= m_capacity)
+        return std::nullopt;
+
+    // Most misses stop here, without touching the string.
+    uint8_t check = (uint8_t)(((key[0] & 0x7) << 5) | ((uint8_t)key.size() & 0x1f));
+    if (m_data[m_checkBytesOffset + index] != check)
+        return std::nullopt;
+    if (m_layout == Dyld4Layout && Read32(m_offsetsOffset + 4 * (size_t)index) == m_sentinel)
+        return std::nullopt;
+
+    uint64_t address = StringAddress(index);
+    size_t available = 0;
+    auto data = (const char*)vm.ResolveAddress(address, &available);
+    if (!data)
+        return std::nullopt;
+    if (available > key.size())
+    {
+        if (memcmp(data, key.data(), key.size()) != 0 || data[key.size()] != 0)
+            return std::nullopt;
+    }
+    else if (vm.ReadNullTermString(address) != key)
+        return std::nullopt;
+
+    return index;
+}
+
+
+uint64_t ObjCHashTable::StringAddress(uint32_t index) const
+{
+    return m_address + (int64_t)(int32_t)Read32(m_offsetsOffset + 4 * (size_t)index);
+}
+
+
+void ObjCHashTable::ObjectAt(size_t entryOffset, uint64_t cacheBase, std::vector<uint64_t>& out) const
+{
+    if (m_layout == LegacyLayout)
+        out.push_back(m_address + (int64_t)(int32_t)Read32(entryOffset));
+    else
+        out.push_back(cacheBase + ((Read64(entryOffset) >> 1) & ObjectOffsetMask));
+}
+
+
+std::vector<uint64_t> ObjCHashTable::ObjectAddresses(uint32_t index, uint64_t cacheBase) const
+{
+    std::vector<uint64_t> objects;
+    if (!m_data || !m_objectsOffset || index >= m_capacity)
+        return objects;
+
+    size_t entry = m_objectsOffset + (size_t)index * ObjectEntrySize;
+    uint64_t duplicateIndex;
+    uint64_t duplicateCount;
+    if (m_layout == LegacyLayout)
+    {
+        // objc_classheader_t: {clsOffset, hiOffset}; an odd clsOffset means {duplicate index << 1 | 1, count}
+        uint32_t clsOffset = Read32(entry);
+        if (!(clsOffset & 1))
+        {
+            ObjectAt(entry, cacheBase, objects);
+            return objects;
+        }
+        duplicateIndex = clsOffset >> 1;
+        duplicateCount = Read32(entry + 4);
+    }
+    else
+    {
+        // {isDuplicate:1, objectCacheOffset:47, dylibObjCIndex:16}, or {isDuplicate:1, index:47, count:16}
+        uint64_t raw = Read64(entry);
+        if (!(raw & 1))
+        {
+            ObjectAt(entry, cacheBase, objects);
+            return objects;
+        }
+        duplicateIndex = (raw >> 1) & ObjectOffsetMask;
+        duplicateCount = raw >> 48;
+    }
+
+    if (duplicateIndex + duplicateCount > m_duplicateCount)
+        return objects;
+    for (uint64_t i = 0; i < duplicateCount; i++)
+        ObjectAt(m_duplicatesOffset + (size_t)(duplicateIndex + i) * ObjectEntrySize, cacheBase, objects);
+    return objects;
+}
+
+
+bool ObjCOptimizations::LoadDyld4(CacheSession& session)
+{
+    const auto& header = session.Header();
+    if (header.mappingOffset < offsetof(dyld_cache_header, objcOptsSize) + sizeof(header.objcOptsSize)
+        || !header.objcOptsOffset)
+        return false;
+
+    ObjCOptimizationHeader opts{};
+    try {
+        m_vm->Read(&opts, m_cacheBase + header.objcOptsOffset, sizeof(opts));
+    }
+    catch (MappingReadException& exc)
+    {
+        return false;
+    }
+    if (opts.version != 1)
+        return false;
+
+    if (opts.selectorHashTableCacheOffset)
+        m_selectors.Load(*m_vm, m_cacheBase + opts.selectorHashTableCacheOffset, ObjCHashTable::Dyld4Layout, false);
+    if (opts.classHashTableCacheOffset)
+        m_classes.Load(*m_vm, m_cacheBase + opts.classHashTableCacheOffset, ObjCHashTable::Dyld4Layout, true);
+    if (opts.protocolHashTableCacheOffset)
+        m_protocols.Load(*m_vm, m_cacheBase + opts.protocolHashTableCacheOffset, ObjCHashTable::Dyld4Layout, true);
+    if (opts.relativeMethodSelectorBaseAddressOffset)
+        m_relativeMethodSelectorBase = m_cacheBase + opts.relativeMethodSelectorBaseAddressOffset;
+
+    return m_selectors.IsLoaded() || m_classes.IsLoaded() || m_protocols.IsLoaded();
+}
+
+
+bool ObjCOptimizations::LoadLegacy(CacheSession& session)
+{
+    auto image = session.ImageWithInstallName("/usr/lib/libobjc.A.dylib");
+    if (!image)
+        return false;
+    auto section = session.SectionNamed(image - session.Images().data(), "__TEXT", "__objc_opt_ro");
+    if (!section)
+        return false;
+
+    uint64_t opt = section->start;
+    int32_t selopt = 0;
+    int32_t clsopt = 0;
+    int32_t protocolopt = 0;
+    int32_t largeClsopt = 0;
+    int32_t largeProtocolopt = 0;
+    try {
+        switch (m_vm->ReadUInt32(opt))
+        {
+            case 12:
+            case 13:
+            case 14:
+                // {version, selopt, headeropt, clsopt, protocolopt}; that protocol table predates the class layout.
+                selopt = m_vm->ReadInt32(opt + 4);
+                clsopt = m_vm->ReadInt32(opt + 12);
+                break;
+            case 16:
+                // v15 plus {largeSharedCachesClassOffset, largeSharedCachesProtocolOffset,
+                //  relativeMethodSelectorBaseAddressOffset}; large caches keep their tables in the dyld4 layout.
+                largeClsopt = m_vm->ReadInt32(opt + 32);
+                largeProtocolopt = m_vm->ReadInt32(opt + 36);
+                if (int64_t base = m_vm->ReadLong(opt + 40))
+                    m_relativeMethodSelectorBase = opt + base;
+                [[fallthrough]];
+            case 15:
+                // {version, flags, selopt, headeropt_ro, clsopt, unused, headeropt_rw, protocolopt2}
+                selopt = m_vm->ReadInt32(opt + 8);
+                clsopt = m_vm->ReadInt32(opt + 16);
+                protocolopt = m_vm->ReadInt32(opt + 28);
+                break;
+            default:
+                return false;
+        }
+    }
+    catch (MappingReadException& exc)
+    {
+        return false;
+    }
+
+    if (selopt)
+        m_selectors.Load(*m_vm, opt + selopt, ObjCHashTable::LegacyLayout, false);
+    if (largeClsopt)
+        m_classes.Load(*m_vm, opt + largeClsopt, ObjCHashTable::Dyld4Layout, true);
+    else if (clsopt)
+        m_classes.Load(*m_vm, opt + clsopt, ObjCHashTable::LegacyLayout, true);
+    if (largeProtocolopt)
+        m_protocols.Load(*m_vm, opt + largeProtocolopt, ObjCHashTable::Dyld4Layout, true);
+    else if (protocolopt)
+        m_protocols.Load(*m_vm, opt + protocolopt, ObjCHashTable::LegacyLayout, true);
+
+    return m_selectors.IsLoaded() || m_classes.IsLoaded() || m_protocols.IsLoaded();
+}
+
+
+std::unique_ptr<ObjCOptimizations> ObjCOptimizations::Load(CacheSession& session)
+{
+    auto opts = std::make_unique<ObjCOptimizations>();
+    opts->m_vm = session.GetVM();
+    if (!opts->m_vm)
+        return nullptr;
+
+    // dyld4 offsets are from the cache header, which sits at the start of the first mapping.
+    dyld_cache_mapping_info mapping{};
+    session.BaseFile()->Read(&mapping, session.Header().mappingOffset, sizeof(mapping));
+    opts->m_cacheBase = mapping.address;
+
+    if (!opts->LoadDyld4(session) && !opts->LoadLegacy(session))
+        return nullptr;
+    return opts;
+}
+
+
+std::optional<uint64_t> ObjCOptimizations::SelectorAddress(std::string_view name) const
+{
+    if (auto index = m_selectors.Find(*m_vm, name))
+        return m_selectors.StringAddress(*index);
+    return std::nullopt;
+}
+
+
+std::vector<uint64_t> ObjCOptimizations::ClassAddresses(std::string_view name) const
+{
+    if (auto index = m_classes.Find(*m_vm, name))
+        return m_classes.ObjectAddresses(*index, m_cacheBase);
+    return {};
+}
+
+
+std::vector<uint64_t> ObjCOptimizations::ProtocolAddresses(std::string_view name) const
+{
+    if (auto index = m_protocols.Find(*m_vm, name))
+        return m_protocols.ObjectAddresses(*index, m_cacheBase);
+    return {};
+}
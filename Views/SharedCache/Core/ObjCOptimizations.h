@@ -0,0 +1,101 @@
+#ifndef KSUITE_OBJCOPTIMIZATIONS_H
+#define KSUITE_OBJCOPTIMIZATIONS_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+class VM;
+class CacheSession;
+
+
+/*
+ * One of the perfect hash tables libobjc/dyld prebuild into the cache: objc_stringhash_t (and its class/protocol
+ *  variants) in __objc_opt_ro, or dyld4's StringHashTable/ObjectHashTable.
+ *
+ * Lookups hash the key with lookup8, reject most misses on the check byte, and confirm the rest with one string
+ *  compare through the VM. The table itself is used in place when it's contiguous in a mapping.
+ */
+class ObjCHashTable {
+public:
+    enum Layout {
+        LegacyLayout, // objc_opt_t era: 32 bit object offsets from the table, header_info offsets alongside
+        Dyld4Layout,  // 64 bit object entries, offsets from the cache base
+    };
+
+private:
+    uint64_t m_address = 0;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    std::vector<uint8_t> m_owned;
+
+    Layout m_layout = LegacyLayout;
+    uint32_t m_capacity = 0;
+    uint32_t m_shift = 0;
+    uint32_t m_mask = 0;
+    uint32_t m_sentinel = 0;
+    uint64_t m_salt = 0;
+
+    size_t m_tabOffset = 0;
+    size_t m_checkBytesOffset = 0;
+    size_t m_offsetsOffset = 0;
+    size_t m_objectsOffset = 0;    // only for object tables
+    size_t m_duplicatesOffset = 0;
+    uint32_t m_duplicateCount = 0;
+
+    bool Bind(VM& vm, size_t size);
+    uint32_t Read32(size_t offset) const;
+    uint64_t Read64(size_t offset) const;
+    void ObjectAt(size_t entryOffset, uint64_t cacheBase, std::vector<uint64_t>& out) const;
+
+public:
+    // Returns false if there's no sane table at `address`.
+    bool Load(VM& vm, uint64_t address, Layout layout, bool hasObjects);
+
+    bool IsLoaded() const { return m_data != nullptr; };
+    size_t Capacity() const { return m_capacity; };
+
+    // Slot holding `key`, if it's in the table.
+    std::optional<uint32_t> Find(VM& vm, std::string_view key) const;
+
+    uint64_t StringAddress(uint32_t index) const;
+
+    // Every object (class/protocol) registered under the name in slot `index`; duplicates come from different images.
+    std::vector<uint64_t> ObjectAddresses(uint32_t index, uint64_t cacheBase) const;
+};
+
+
+/*
+ * The ObjC lookup tables of a cache: selector name -> selector string, class/protocol name -> definitions.
+ *
+ * Read from the dyld4 ObjC optimization header when the cache has one (iOS 16+), otherwise from libobjc's
+ *  __objc_opt_ro (objc_opt_t v12 to v16). Nothing here needs an image to be loaded.
+ */
+class ObjCOptimizations {
+    std::shared_ptr<VM> m_vm;
+    uint64_t m_cacheBase = 0;
+
+    ObjCHashTable m_selectors;
+    ObjCHashTable m_classes;
+    ObjCHashTable m_protocols;
+    std::optional<uint64_t> m_relativeMethodSelectorBase;
+
+    bool LoadDyld4(CacheSession& session);
+    bool LoadLegacy(CacheSession& session);
+
+public:
+    // Returns nullptr if the cache has no ObjC tables we can read.
+    static std::unique_ptr<ObjCOptimizations> Load(CacheSession& session);
+
+    std::optional<uint64_t> SelectorAddress(std::string_view name) const;
+    std::vector<uint64_t> ClassAddresses(std::string_view name) const;
+    std::vector<uint64_t> ProtocolAddresses(std::string_view name) const;
+
+    // Relative method lists store selectors as offsets from here, when the cache says so.
+    std::optional<uint64_t> RelativeMethodSelectorBase() const { return m_relativeMethodSelectorBase; };
+};
+
+
+#endif //KSUITE_OBJCOPTIMIZATIONS_H
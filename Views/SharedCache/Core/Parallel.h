@@ -0,0 +1,66 @@
+#ifndef KSUITE_PARALLEL_H
+#define KSUITE_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+ * Runs body(i) for every i in [0, count), spread over up to `maxThreads` threads (default: one per core).
+ *
+ * Blocks until every index has been processed. The calling thread does work too.
+ * If any call throws, the first exception is rethrown here once all threads are done.
+ */
+template <typename Body>
+void ParallelFor(size_t count, Body&& body, size_t maxThreads = 0)
+{
+    if (count == 0)
+        return;
+
+    size_t threadCount = maxThreads ? maxThreads : std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, count);
+
+    if (threadCount == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    std::atomic<size_t> next {0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            try {
+                body(i);
+            }
+            catch (...)
+            {
+                std::unique_lock<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+#endif //KSUITE_PARALLEL_H
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "SlideInfo.h"
+#include "VM.h"
+
+
+SlideInfo::SlideInfo(MMappedFileAccessor* file, const dyld_cache_mapping_and_slide_info& mapping)
+{
+    auto data = (uint8_t*)file->Data();
+    size_t length = file->Length();
+
+    if (mapping.fileOffset > length || mapping.size > length - mapping.fileOffset)
+        throw SlideInfoException();
+    if (mapping.slideInfoFileOffset > length || mapping.slideInfoFileSize > length - mapping.slideInfoFileOffset)
+        throw SlideInfoException();
+    if (mapping.slideInfoFileSize < sizeof(uint32_t) * 4)
+        throw SlideInfoException();
+
+    // Cache files are mapped read-only; rebasing writes into (private copies of) this mapping's pages.
+    if (!file->MakeWritable(mapping.fileOffset, mapping.size))
+        throw SlideInfoException();
+    m_data = data + mapping.fileOffset;
+    m_fileStart = mapping.fileOffset;
+    m_fileEnd = mapping.fileOffset + mapping.size;
+    m_info = data + mapping.slideInfoFileOffset;
+    m_infoSize = mapping.slideInfoFileSize;
+
+    memcpy(&m_version, m_info, sizeof(uint32_t));
+    memcpy(&m_pageSize, m_info + 4, sizeof(uint32_t));
+    // Anything else means garbage, and a zero page size would have us divide by zero on every read.
+    if (m_pageSize != 0x1000 && m_pageSize != 0x4000)
+        throw SlideInfoException();
+
+    switch (m_version)
+    {
+        case 2: {
+            if (m_infoSize < sizeof(dyld_cache_slide_info2))
+                throw SlideInfoException();
+            dyld_cache_slide_info2 info{};
+            memcpy(&info, m_info, sizeof(info));
+            if ((size_t)info.page_starts_offset + (size_t)info.page_starts_count * 2 > m_infoSize
+                || (size_t)info.page_extras_offset + (size_t)info.page_extras_count * 2 > m_infoSize
+                || info.delta_mask == 0 || __builtin_ctzll(info.delta_mask) < 2)
+                throw SlideInfoException();
+            m_pageStartsCount = info.page_starts_count;
+            m_pageStarts = (const uint16_t*)(m_info + info.page_starts_offset);
+            m_pageExtrasCount = info.page_extras_count;
+            m_pageExtras = (const uint16_t*)(m_info + info.page_extras_offset);
+            m_deltaMask = info.delta_mask;
+            m_valueAdd = info.value_add;
+            break;
+        }
+        case 3: {
+            dyld_cache_slide_info3 info{};
+            memcpy(&info, m_info, sizeof(info));
+            if (sizeof(info) + (size_t)info.page_starts_count * 2 > m_infoSize)
+                throw SlideInfoException();
+            m_pageStartsCount = info.page_starts_count;
+            m_pageStarts = (const uint16_t*)(m_info + sizeof(info));
+            m_authValueAdd = info.auth_value_add;
+            break;
+        }
+        case 5: {
+            dyld_cache_slide_info5 info{};
+            memcpy(&info, m_info, sizeof(info));
+            if (sizeof(info) + (size_t)info.page_starts_count * 2 > m_infoSize)
+                throw SlideInfoException();
+            m_pageStartsCount = info.page_starts_count;
+            m_pageStarts = (const uint16_t*)(m_info + sizeof(info));
+            m_valueAdd = info.value_add;
+            break;
+        }
+        default:
+            // v1 is long dead, v4 is arm64_32 only.
+            throw SlideInfoException();
+    }
+
+    // Pages past the end of the mapping can't be addressed, don't trust the count further than that.
+    m_pageStartsCount = std::min<size_t>(m_pageStartsCount, (mapping.size + m_pageSize - 1) / m_pageSize);
+
+    m_pageState = std::unique_ptr<std::atomic<uint8_t>[]>(new std::atomic<uint8_t>[m_pageStartsCount]);
+    for (size_t i = 0; i < m_pageStartsCount; i++)
+        m_pageState[i].store(PageUnslid, std::memory_order_relaxed);
+}
+
+
+void SlideInfo::SlidePage(size_t pageIndex) noexcept
+{
+    auto& state = m_pageState[pageIndex];
+    uint8_t expected = PageUnslid;
+    if (!state.compare_exchange_strong(expected, PageSliding, std::memory_order_acq_rel))
+    {
+        // Someone else got here first; it's a handful of microseconds, wait it out.
+        while (state.load(std::memory_order_acquire) != PageSlid)
+            std::this_thread::yield();
+        return;
+    }
+
+    uint8_t* page = m_data + pageIndex * m_pageSize;
+    // The last page of a mapping can be short; never chase a chain past the end of the mapping.
+    uint32_t pageLength = (uint32_t)std::min<size_t>(m_pageSize, m_fileEnd - (m_fileStart + pageIndex * m_pageSize));
+    uint16_t pageStart;
+    memcpy(&pageStart, &m_pageStarts[pageIndex], sizeof(pageStart));
+
+    switch (m_version)
+    {
+        case 2:
+            SlidePageV2(page, pageLength, pageStart);
+            break;
+        case 3:
+            SlidePageV3(page, pageLength, pageStart);
+            break;
+        case 5:
+            SlidePageV5(page, pageLength, pageStart);
+            break;
+    }
+
+    state.store(PageSlid, std::memory_order_release);
+}
+
+
+/*
+ * Each page is rebased in two passes.
+ *
+ * Walking a chain is inherently serial (the next offset lives in the value we're at), so the first pass only
+ *  collects the chain's offsets. The second pass decodes every collected pointer with the same straight-line,
+ *  branch-free arithmetic, which the compiler is free to vectorize.
+ */
+
+static inline uint64_t LoadPointer(const uint8_t* page, uint32_t offset)
+{
+    uint64_t value;
+    memcpy(&value, page + offset, sizeof(value));
+    return value;
+}
+
+static inline void StorePointer(uint8_t* page, uint32_t offset, uint64_t value)
+{
+    memcpy(page + offset, &value, sizeof(value));
+}
+
+// Scratch space for one page's worth of chain offsets, reused across pages on each thread.
+static std::vector<uint32_t>& ChainOffsets(size_t pageSize)
+{
+    thread_local std::vector<uint32_t> offsets;
+    offsets.clear();
+    offsets.reserve(pageSize / 4);
+    return offsets;
+}
+
+
+void SlideInfo::SlidePageV2(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept
+{
+    if (pageStart == DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE)
+        return;
+
+    auto& offsets = ChainOffsets(m_pageSize);
+    const uint64_t deltaMask = m_deltaMask;
+    const uint64_t valueMask = ~deltaMask;
+    const uint64_t valueAdd = m_valueAdd;
+    const unsigned deltaShift = __builtin_ctzll(deltaMask) - 2;
+
+    auto gatherChain = [&](uint32_t offset) {
+        while (offset + sizeof(uint64_t) <= pageLength && offsets.size() < m_pageSize / 4)
+        {
+            offsets.push_back(offset);
+            uint32_t delta = (uint32_t)((LoadPointer(page, offset) & deltaMask) >> deltaShift);
+            if (delta == 0)
+                break;
+            offset += delta;
+        }
+    };
+
+    if (pageStart & DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA)
+    {
+        for (uint32_t i = pageStart & ~DYLD_CACHE_SLIDE_PAGE_ATTRS; i < m_pageExtrasCount; i++)
+        {
+            uint16_t extra;
+            memcpy(&extra, &m_pageExtras[i], sizeof(extra));
+            gatherChain((uint32_t)(extra & ~DYLD_CACHE_SLIDE_PAGE_ATTRS) * 4);
+            if (extra & DYLD_CACHE_SLIDE_PAGE_ATTR_END)
+                break;
+        }
+    }
+    else
+        gatherChain((uint32_t)pageStart * 4);
+
+    const size_t count = offsets.size();
+    const uint32_t* offs = offsets.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t value = LoadPointer(page, offs[i]) & valueMask;
+        // Zero stays zero (it's a NULL, not a pointer to the cache base)
+        value += valueAdd & (0 - (uint64_t)(value != 0));
+        StorePointer(page, offs[i], value);
+    }
+}
+
+
+void SlideInfo::SlidePageV3(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept
+{
+    if (pageStart == DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE)
+        return;
+
+    auto& offsets = ChainOffsets(m_pageSize);
+    uint32_t offset = pageStart;
+    while (offset + sizeof(uint64_t) <= pageLength)
+    {
+        offsets.push_back(offset);
+        uint32_t delta = (uint32_t)((LoadPointer(page, offset) >> 51) & 0x7FF) * 8;
+        if (delta == 0)
+            break;
+        offset += delta;
+    }
+
+    const uint64_t authValueAdd = m_authValueAdd;
+    const size_t count = offsets.size();
+    const uint32_t* offs = offsets.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t raw = LoadPointer(page, offs[i]);
+        uint64_t authMask = 0 - (raw >> 63);
+
+        // Authenticated: 32 bit offset from the cache base.
+        uint64_t authValue = (raw & 0xFFFFFFFFULL) + authValueAdd;
+        // Plain: 51 bit target, top 8 bits of the pointer packed down at bit 43.
+        uint64_t plainValue = ((raw & 0x0007F80000000000ULL) << 13) | (raw & 0x000007FFFFFFFFFFULL);
+
+        StorePointer(page, offs[i], (authValue & authMask) | (plainValue & ~authMask));
+    }
+}
+
+
+void SlideInfo::SlidePageV5(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept
+{
+    if (pageStart == DYLD_CACHE_SLIDE_V5_PAGE_ATTR_NO_REBASE)
+        return;
+
+    auto& offsets = ChainOffsets(m_pageSize);
+    uint32_t offset = pageStart;
+    while (offset + sizeof(uint64_t) <= pageLength)
+    {
+        offsets.push_back(offset);
+        uint32_t delta = (uint32_t)((LoadPointer(page, offset) >> 52) & 0x7FF) * 8;
+        if (delta == 0)
+            break;
+        offset += delta;
+    }
+
+    const uint64_t valueAdd = m_valueAdd;
+    const size_t count = offsets.size();
+    const uint32_t* offs = offsets.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t raw = LoadPointer(page, offs[i]);
+        uint64_t authMask = 0 - (raw >> 63);
+
+        // 34 bit runtime offset from the cache base; plain pointers also carry their top byte.
+        uint64_t value = valueAdd + (raw & 0x3FFFFFFFFULL);
+        uint64_t high8 = ((raw >> 34) & 0xFF) << 56;
+
+        StorePointer(page, offs[i], value | (high8 & ~authMask));
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef KSUITE_SLIDEINFO_H
+#define KSUITE_SLIDEINFO_H
+
+#include <atomic>
+#include <memory>
+#include "CacheHeader.h"
+
+class MMappedFileAccessor;
+
+
+class SlideInfoException : public std::exception {
+    virtual const char *what() const throw() {
+        return "Unsupported or malformed slide info";
+    }
+};
+
+
+/*
+ * Rebases the pointers of one slid mapping (dyld_cache_mapping_and_slide_info), in place, a page at a time.
+ *
+ * Pages are rebased the first time something resolves an address in them, so opening a cache costs nothing
+ *  and only pages we actually look at are touched. Pointers are rebased to their unslid target
+ *  (i.e. as if the cache was loaded at its preferred address), with PAC/auth bits stripped.
+ *
+ * Supports slide info v2, v3 and v5.
+ */
+class SlideInfo {
+    enum PageState : uint8_t {
+        PageUnslid,
+        PageSliding,
+        PageSlid,
+    };
+
+    uint8_t* m_data; // Start of the slid mapping, inside the private file mapping, made writable for us
+    size_t m_fileStart;
+    size_t m_fileEnd;
+
+    const uint8_t* m_info;
+    size_t m_infoSize;
+    uint32_t m_version;
+    uint32_t m_pageSize;
+    uint32_t m_pageStartsCount;
+    const uint16_t* m_pageStarts;
+
+    // v2
+    const uint16_t* m_pageExtras = nullptr;
+    uint32_t m_pageExtrasCount = 0;
+    uint64_t m_deltaMask = 0;
+    uint64_t m_valueAdd = 0;
+    // v3
+    uint64_t m_authValueAdd = 0;
+
+    std::unique_ptr<std::atomic<uint8_t>[]> m_pageState;
+
+    void SlidePage(size_t pageIndex) noexcept;
+    void SlidePageV2(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept;
+    void SlidePageV3(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept;
+    void SlidePageV5(uint8_t* page, uint32_t pageLength, uint16_t pageStart) noexcept;
+
+public:
+    // Throws SlideInfoException if the slide info is out of bounds or an unsupported version,
+    //  or the mapping can't be made writable.
+    SlideInfo(MMappedFileAccessor* file, const dyld_cache_mapping_and_slide_info& mapping);
+
+    uint32_t Version() const { return m_version; };
+    uint32_t PageSize() const { return m_pageSize; };
+
+    bool Contains(size_t fileOffset) const { return fileOffset >= m_fileStart && fileOffset < m_fileEnd; };
+
+    // File offset of the end of the slide page containing `fileOffset`.
+    size_t PageEnd(size_t fileOffset) const {
+        return m_fileStart + ((fileOffset - m_fileStart) / m_pageSize + 1) * m_pageSize;
+    };
+
+    // Makes sure the page containing `fileOffset` has been rebased. Thread safe, cheap once the page is done.
+    void EnsureSlid(size_t fileOffset) noexcept
+    {
+        size_t pageIndex = (fileOffset - m_fileStart) / m_pageSize;
+        if (pageIndex >= m_pageStartsCount)
+            return;
+        if (m_pageState[pageIndex].load(std::memory_order_acquire) == PageSlid)
+            return;
+        SlidePage(pageIndex);
+    };
+};
+
+
+#endif //KSUITE_SLIDEINFO_H
@@ -0,0 +1,80 @@
+#include <cstring>
+#include <mutex>
+#include "StringTable.h"
+#include "VM.h"
+
+
+uint32_t StringTable::InsertLocked(std::string_view value, bool copy)
+{
+    if (auto it = m_idsByValue.find(value); it != m_idsByValue.end())
+        return it->second;
+
+    if (copy)
+        value = m_ownedValues.emplace_back(value);
+
+    auto id = (uint32_t)m_values.size();
+    m_values.push_back(value);
+    m_idsByValue.emplace(value, id);
+    return id;
+}
+
+
+InternedString StringTable::AtAddress(VM& vm, uint64_t address)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (auto it = m_idsByAddress.find(address); it != m_idsByAddress.end())
+            return {it->second, m_values[it->second]};
+    }
+
+    size_t available;
+    auto data = (const char*)vm.ResolveAddress(address, &available);
+    if (!data)
+        throw MappingReadException();
+
+    // Nearly every string sits inside one region; the rest cross a slid page or region boundary and need a copy.
+    std::string crossing;
+    std::string_view value;
+    bool copy = false;
+    if (auto end = (const char*)memchr(data, 0, available))
+        value = std::string_view(data, end - data);
+    else
+    {
+        crossing = vm.ReadNullTermString(address);
+        value = crossing;
+        copy = true;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto id = InsertLocked(value, copy);
+    m_idsByAddress.emplace(address, id);
+    return {id, m_values[id]};
+}
+
+
+InternedString StringTable::Intern(std::string_view value)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (auto it = m_idsByValue.find(value); it != m_idsByValue.end())
+            return {it->second, m_values[it->second]};
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto id = InsertLocked(value, true);
+    return {id, m_values[id]};
+}
+
+
+std::string_view StringTable::Value(uint32_t id) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return id < m_values.size() ? m_values[id] : std::string_view();
+}
+
+
+size_t StringTable::Size() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_values.size();
+}
@@ -0,0 +1,66 @@
+#ifndef KSUITE_STRINGTABLE_H
+#define KSUITE_STRINGTABLE_H
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class VM;
+
+
+struct InternedString {
+    uint32_t id = UINT32_MAX;
+    // Points into the mapped cache (or, rarely, into the table itself); valid for as long as the table is.
+    std::string_view value;
+
+    bool operator==(const InternedString& other) const { return id == other.id; };
+    bool operator!=(const InternedString& other) const { return id != other.id; };
+
+    std::string str() const { return std::string(value); };
+};
+
+
+/*
+ * Interns the C strings ObjC processing reads out of a cache (selectors, class names, type encodings).
+ *
+ * Symbol names don't go through here: SymbolIndex packs export names into one buffer that's saved to the sidecar
+ *  as is, and the names ParseExportTrie hands to DefineUserSymbol are copied by the core regardless.
+ *
+ * Strings are found by VM address and handed out as views straight into the mapped files, so looking one up
+ *  doesn't allocate. Equal contents share an ID no matter how many addresses they live at, which makes
+ *  comparing two interned strings an integer compare.
+ *
+ * Thread safe; lookups of already interned addresses only take a shared lock.
+ */
+class StringTable {
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<uint64_t, uint32_t> m_idsByAddress;
+    std::unordered_map<std::string_view, uint32_t> m_idsByValue;
+    std::vector<std::string_view> m_values;
+    // Backing storage for strings that aren't contiguous in a mapping, or don't come from the cache at all.
+    std::deque<std::string> m_ownedValues;
+
+    // Caller holds the unique lock.
+    uint32_t InsertLocked(std::string_view value, bool copy);
+
+public:
+    /*
+     * The null terminated string at `address`.
+     * Throws MappingReadException if it isn't mapped.
+     */
+    InternedString AtAddress(VM& vm, uint64_t address);
+
+    // Interns a string that isn't (necessarily) in the cache, e.g. a synthesized name. `value` is copied if new.
+    InternedString Intern(std::string_view value);
+
+    std::string_view Value(uint32_t id) const;
+
+    size_t Size() const;
+};
+
+
+#endif //KSUITE_STRINGTABLE_H
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include "SymbolIndex.h"
+#include "CacheSession.h"
+#include "ExportTrie.h"
+#include "IndexCache.h"
+#include "Parallel.h"
+#include "Log.h"
+#include "MachO.h"
+
+
+namespace {
+    // What one image contributes, before the per-image results are merged.
+    struct ImageExports {
+        std::string names;
+        std::vector<std::pair<uint64_t, uint32_t>> symbols; // address, offset into names
+    };
+}
+
+
+/*
+ * Finds the export trie of the image at `headerAddress` by walking its load commands through the VM, and walks it.
+ *
+ * The trie is read in place when it sits inside one mapping, which it nearly always does.
+ */
+static void ReadImageExports(VM& vm, uint64_t headerAddress, ImageExports& out)
+{
+    MachO::mach_header_64 header{};
+    vm.Read(&header, headerAddress, sizeof(header));
+
+    uint64_t textBase = 0;
+    uint64_t linkeditAddress = 0;
+    uint64_t linkeditFileOffset = 0;
+    uint32_t trieOffset = 0;
+    uint32_t trieSize = 0;
+
+    uint64_t cursor = headerAddress + sizeof(MachO::mach_header_64);
+    for (size_t i = 0; i < header.ncmds; i++)
+    {
+        uint32_t cmd = vm.ReadUInt32(cursor);
+        uint32_t cmdSize = vm.ReadUInt32(cursor + 4);
+        switch (cmd)
+        {
+            case LC_SEGMENT_64: {
+                MachO::segment_command_64 seg{};
+                vm.Read(&seg, cursor, sizeof(seg));
+                if (strncmp(seg.segname, "__TEXT", 16) == 0)
+                    textBase = seg.vmaddr;
+                else if (strncmp(seg.segname, "__LINKEDIT", 16) == 0)
+                {
+                    linkeditAddress = seg.vmaddr;
+                    linkeditFileOffset = seg.fileoff;
+                }
+                break;
+            }
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                MachO::dyld_info_command info{};
+                vm.Read(&info, cursor, sizeof(info));
+                if (info.export_size)
+                {
+                    trieOffset = info.export_off;
+                    trieSize = info.export_size;
+                }
+                break;
+            }
+            case LC_DYLD_EXPORTS_TRIE: {
+                MachO::linkedit_data_command trie{};
+                vm.Read(&trie, cursor, sizeof(trie));
+                trieOffset = trie.dataoff;
+                trieSize = trie.datasize;
+                break;
+            }
+            default:
+                break;
+        }
+        if (cmdSize == 0)
+            break;
+        cursor += cmdSize;
+    }
+
+    if (!trieSize || !linkeditAddress || trieOffset < linkeditFileOffset)
+        return;
+
+    uint64_t trieAddress = linkeditAddress + (trieOffset - linkeditFileOffset);
+    size_t available = 0;
+    auto trie = (const uint8_t*)vm.ResolveAddress(trieAddress, &available);
+    std::vector<uint8_t> copy;
+    if (!trie || available < trieSize)
+    {
+        copy.resize(trieSize);
+        vm.Read(copy.data(), trieAddress, trieSize);
+        trie = copy.data();
+    }
+
+    ExportTrie::ForEachExport(trie, trieSize, [&](const std::string& name, uint64_t flags, uint64_t offset) {
+        uint64_t address = ExportTrie::ExportAddress(textBase, flags, offset);
+        out.symbols.emplace_back(address, (uint32_t)out.names.size());
+        out.names.append(name);
+        out.names.push_back('\0');
+    });
+}
+
+
+void SymbolIndex::AddExports(CacheSession& session, const std::atomic<bool>& cancelled)
+{
+    auto vm = session.GetVM();
+    const auto& images = session.Images();
+
+    std::vector<ImageExports> perImage(images.size());
+    ParallelFor(images.size(), [&](size_t i) {
+        if (cancelled)
+            return;
+        try {
+            ReadImageExports(*vm, images[i].headerAddress, perImage[i]);
+        }
+        catch (MappingReadException& exc)
+        {
+            // Header or trie isn't mapped (missing subcache).
+        }
+        catch (ExportTrieException& exc)
+        {
+            // Keep whatever was visited before the trie went bad.
+        }
+    });
+
+    size_t namesSize = 0;
+    size_t count = 0;
+    for (const auto& image : perImage)
+    {
+        namesSize += image.names.size();
+        count += image.symbols.size();
+    }
+    if (namesSize >= LocalNameFlag)
+        return;
+
+    m_ownedNames.reserve(namesSize);
+    m_ownedEntries.reserve(m_ownedEntries.size() + count);
+    for (size_t i = 0; i < perImage.size(); i++)
+    {
+        auto base = (uint32_t)m_ownedNames.size();
+        for (const auto& [address, name] : perImage[i].symbols)
+            m_ownedEntries.push_back({address, base + name, (uint32_t)i});
+        m_ownedNames.append(perImage[i].names);
+        perImage[i] = {};
+    }
+}
+
+
+namespace {
+    struct LocalSymbols {
+        std::shared_ptr<MMappedFileAccessor> file;
+        const uint8_t* chunk;
+        dyld_cache_local_symbols_info info;
+        bool wideEntries;
+        size_t entrySize;
+    };
+}
+
+
+// Finds and bounds checks the local symbols info. Split caches keep it in their own file; older caches in the base one.
+static bool FindLocalSymbols(CacheSession& session, LocalSymbols& out)
+{
+    std::shared_ptr<MMappedFileAccessor> file;
+    dyld_cache_header header{};
+    for (const auto& candidate : {session.LocalSymbolsFile(), session.BaseFile()})
+    {
+        if (!candidate || candidate->Length() < sizeof(header.magic) + 8)
+            continue;
+        size_t headerSize = candidate->ReadUInt32(offsetof(dyld_cache_header, mappingOffset));
+        header = {};
+        candidate->Read(&header, 0, std::min({headerSize, sizeof(dyld_cache_header), candidate->Length()}));
+        if (headerSize > offsetof(dyld_cache_header, localSymbolsSize) && header.localSymbolsOffset
+            && header.localSymbolsOffset + sizeof(dyld_cache_local_symbols_info) <= candidate->Length())
+        {
+            file = candidate;
+            break;
+        }
+    }
+    if (!file)
+        return false;
+
+    auto chunk = (const uint8_t*)file->Data() + header.localSymbolsOffset;
+    size_t chunkSize = std::min<uint64_t>(header.localSymbolsSize, file->Length() - header.localSymbolsOffset);
+
+    dyld_cache_local_symbols_info info{};
+    memcpy(&info, chunk, sizeof(info));
+    bool wideEntries = header.mappingOffset >= offsetof(dyld_cache_header, symbolFileUUID);
+    size_t entrySize = wideEntries ? sizeof(dyld_cache_local_symbols_entry_64) : sizeof(dyld_cache_local_symbols_entry);
+    if ((uint64_t)info.nlistOffset + (uint64_t)info.nlistCount * sizeof(MachO::nlist_64) > chunkSize
+        || (uint64_t)info.stringsOffset + info.stringsSize > chunkSize
+        || (uint64_t)info.entriesOffset + (uint64_t)info.entriesCount * entrySize > chunkSize
+        || info.stringsSize >= 0x80000000)
+    {
+        CoreLogError("Malformed local symbols info in %s, skipping local symbols", file->Path().c_str());
+        return false;
+    }
+
+    out = {file, chunk, info, wideEntries, entrySize};
+    return true;
+}
+
+
+void SymbolIndex::AddLocals(CacheSession& session, const std::atomic<bool>& cancelled)
+{
+    LocalSymbols locals;
+    if (!FindLocalSymbols(session, locals))
+        return;
+    const auto& info = locals.info;
+    auto chunk = locals.chunk;
+    auto wideEntries = locals.wideEntries;
+    auto entrySize = locals.entrySize;
+
+    // Entries locate their image by its offset from the start of the cache.
+    dyld_cache_mapping_info firstMapping{};
+    session.BaseFile()->Read(&firstMapping, session.Header().mappingOffset, sizeof(firstMapping));
+    std::unordered_map<uint64_t, uint32_t> imagesByAddress;
+    for (size_t i = 0; i < session.Images().size(); i++)
+        imagesByAddress.emplace(session.Images()[i].headerAddress, (uint32_t)i);
+
+    m_localsFile = locals.file;
+    m_localStrings = (const char*)chunk + info.stringsOffset;
+    m_localStringsSize = info.stringsSize;
+    auto nlists = (const MachO::nlist_64*)(chunk + info.nlistOffset);
+
+    std::vector<std::vector<Entry>> perEntry(info.entriesCount);
+    ParallelFor(info.entriesCount, [&](size_t i) {
+        if (cancelled)
+            return;
+        dyld_cache_local_symbols_entry_64 entry{};
+        if (wideEntries)
+            memcpy(&entry, chunk + info.entriesOffset + i * entrySize, sizeof(entry));
+        else
+        {
+            dyld_cache_local_symbols_entry narrow{};
+            memcpy(&narrow, chunk + info.entriesOffset + i * entrySize, sizeof(narrow));
+            entry = {narrow.dylibOffset, narrow.nlistStartIndex, narrow.nlistCount};
+        }
+
+        auto image = imagesByAddress.find(firstMapping.address + entry.dylibOffset);
+        if (image == imagesByAddress.end()
+            || (uint64_t)entry.nlistStartIndex + entry.nlistCount > info.nlistCount)
+            return;
+
+        auto& out = perEntry[i];
+        for (uint32_t j = 0; j < entry.nlistCount; j++)
+        {
+            MachO::nlist_64 nlist;
+            memcpy(&nlist, &nlists[entry.nlistStartIndex + j], sizeof(nlist));
+            if ((nlist.n_type & N_STAB) || (nlist.n_type & N_TYPE) != N_SECT || nlist.n_value == 0
+                || nlist.n_strx >= info.stringsSize)
+                continue;
+            auto name = m_localStrings + nlist.n_strx;
+            if (*name == '\0' || strcmp(name, "<redacted>") == 0)
+                continue;
+            out.push_back({nlist.n_value, nlist.n_strx, image->second | LocalNameFlag});
+        }
+    });
+
+    size_t count = 0;
+    for (const auto& entries : perEntry)
+        count += entries.size();
+    m_ownedEntries.reserve(m_ownedEntries.size() + count);
+    for (auto& entries : perEntry)
+    {
+        m_ownedEntries.insert(m_ownedEntries.end(), entries.begin(), entries.end());
+        entries = {};
+    }
+}
+
+
+std::shared_ptr<SymbolIndex> SymbolIndex::Build(CacheSession& session, const std::atomic<bool>& cancelled)
+{
+    auto index = std::make_shared<SymbolIndex>();
+    index->AddExports(session, cancelled);
+    index->AddLocals(session, cancelled);
+    if (cancelled)
+        return nullptr;
+
+    // Stable, so an export wins over a local at the same address.
+    auto& entries = index->m_ownedEntries;
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.address < b.address;
+    });
+    entries.shrink_to_fit();
+    index->m_entries = entries.data();
+    index->m_entryCount = entries.size();
+    index->m_names = index->m_ownedNames.data();
+    index->m_namesSize = index->m_ownedNames.size();
+
+    auto& byName = index->m_ownedByName;
+    byName.resize(entries.size());
+    for (size_t i = 0; i < byName.size(); i++)
+        byName[i] = (uint32_t)i;
+    std::sort(byName.begin(), byName.end(), [&](uint32_t a, uint32_t b) {
+        auto nameA = index->NameOf(entries[a]);
+        auto nameB = index->NameOf(entries[b]);
+        if (nameA != nameB)
+            return nameA < nameB;
+        return a < b;
+    });
+    index->m_byName = byName.data();
+
+    return index;
+}
+
+
+std::shared_ptr<SymbolIndex> SymbolIndex::Load(CacheSession& session, const IndexCacheFile& file)
+{
+    auto index = std::make_shared<SymbolIndex>();
+    size_t byNameCount = 0;
+    if (!file.Section(SymbolEntriesSection, index->m_entries, index->m_entryCount)
+        || !file.Section(SymbolsByNameSection, index->m_byName, byNameCount)
+        || !file.Section(SymbolNamesSection, index->m_names, index->m_namesSize)
+        || byNameCount != index->m_entryCount)
+        return nullptr;
+    index->m_indexFile = file.File();
+
+    // Local names still point into the cache's own string pool, which is mapped anyway.
+    LocalSymbols locals;
+    if (FindLocalSymbols(session, locals))
+    {
+        index->m_localsFile = locals.file;
+        index->m_localStrings = (const char*)locals.chunk + locals.info.stringsOffset;
+        index->m_localStringsSize = locals.info.stringsSize;
+    }
+
+    // Don't trust offsets we didn't just compute.
+    for (size_t i = 0; i < index->m_entryCount; i++)
+    {
+        const auto& entry = index->m_entries[i];
+        size_t limit = (entry.image & LocalNameFlag) ? index->m_localStringsSize : index->m_namesSize;
+        if (entry.name >= limit || (entry.image & ~LocalNameFlag) >= session.Images().size()
+            || index->m_byName[i] >= index->m_entryCount)
+            return nullptr;
+    }
+    if (index->m_namesSize && index->m_names[index->m_namesSize - 1] != '\0')
+        return nullptr;
+
+    return index;
+}
+
+
+void SymbolIndex::Save(IndexCacheWriter& writer) const
+{
+    writer.AddSection(SymbolEntriesSection, sizeof(Entry), m_entries, m_entryCount);
+    writer.AddSection(SymbolsByNameSection, sizeof(uint32_t), m_byName, m_entryCount);
+    writer.AddSection(SymbolNamesSection, 1, m_names, m_namesSize);
+}
+
+
+std::string_view SymbolIndex::NameOf(const Entry& entry) const
+{
+    if (entry.image & LocalNameFlag)
+        return std::string_view(m_localStrings + entry.name,
+                                strnlen(m_localStrings + entry.name, m_localStringsSize - entry.name));
+    return std::string_view(m_names + entry.name);
+}
+
+
+SymbolIndex::Symbol SymbolIndex::SymbolFor(const Entry& entry) const
+{
+    return {entry.address, entry.image & ~LocalNameFlag, NameOf(entry)};
+}
+
+
+bool SymbolIndex::SymbolAt(uint64_t address, Symbol& out) const
+{
+    auto end = m_entries + m_entryCount;
+    auto it = std::upper_bound(m_entries, end, address, [](uint64_t address, const Entry& entry) {
+        return address < entry.address;
+    });
+    if (it == m_entries)
+        return false;
+
+    // Step back to the first of any symbols sharing that address.
+    uint64_t found = (--it)->address;
+    while (it != m_entries && (it - 1)->address == found)
+        --it;
+    out = SymbolFor(*it);
+    return true;
+}
+
+
+std::vector<SymbolIndex::Symbol> SymbolIndex::SymbolsNamed(std::string_view name) const
+{
+    auto [first, last] = std::equal_range(m_byName, m_byName + m_entryCount, name, [&](const auto& a, const auto& b) {
+        auto nameOf = [&](const auto& value) -> std::string_view {
+            if constexpr (std::is_same_v<std::decay_t<decltype(value)>, uint32_t>)
+                return NameOf(m_entries[value]);
+            else
+                return value;
+        };
+        return nameOf(a) < nameOf(b);
+    });
+
+    std::vector<Symbol> symbols;
+    for (auto it = first; it != last; ++it)
+        symbols.push_back(SymbolFor(m_entries[*it]));
+    return symbols;
+}
@@ -0,0 +1,83 @@
+#ifndef KSUITE_SYMBOLINDEX_H
+#define KSUITE_SYMBOLINDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class CacheSession;
+class MMappedFileAccessor;
+class IndexCacheFile;
+class IndexCacheWriter;
+
+
+/*
+ * Every symbol in a cache: each image's exports, plus the unredacted locals from the .symbols file
+ *  (or the base file, on older caches) when there are any.
+ *
+ * Built without loading any image, then kept in the cache's index cache file and used from there in place on
+ *  later opens. Entries are 16 bytes, sorted by address; names aren't copied out of the local symbol string pool,
+ *  and exports share one blob of NUL separated names.
+ * A second array of entry indices, sorted by name, serves name lookups.
+ */
+class SymbolIndex {
+public:
+    struct Symbol {
+        uint64_t address;
+        uint32_t imageIndex;
+        std::string_view name; // valid for as long as the index is
+    };
+
+private:
+    struct Entry {
+        uint64_t address;
+        uint32_t name;  // offset into m_names, or into the local string pool with LocalNameFlag set on image
+        uint32_t image;
+    };
+    static constexpr uint32_t LocalNameFlag = 0x80000000;
+
+    // Point either into the owned vectors below (freshly built) or into a mapped index cache file.
+    const Entry* m_entries = nullptr;
+    size_t m_entryCount = 0;
+    const uint32_t* m_byName = nullptr;
+    const char* m_names = nullptr;
+    size_t m_namesSize = 0;
+
+    std::vector<Entry> m_ownedEntries;
+    std::vector<uint32_t> m_ownedByName;
+    std::string m_ownedNames;
+    std::shared_ptr<MMappedFileAccessor> m_indexFile;
+
+    std::shared_ptr<MMappedFileAccessor> m_localsFile;
+    const char* m_localStrings = nullptr;
+    size_t m_localStringsSize = 0;
+
+    void AddExports(CacheSession& session, const std::atomic<bool>& cancelled);
+    void AddLocals(CacheSession& session, const std::atomic<bool>& cancelled);
+
+    std::string_view NameOf(const Entry& entry) const;
+    Symbol SymbolFor(const Entry& entry) const;
+
+public:
+    // nullptr if `cancelled` gets set before it's done.
+    static std::shared_ptr<SymbolIndex> Build(CacheSession& session, const std::atomic<bool>& cancelled);
+
+    // Uses the index stored in `file` in place. nullptr if it doesn't hold one.
+    static std::shared_ptr<SymbolIndex> Load(CacheSession& session, const IndexCacheFile& file);
+    // `writer` points into this index; keep it alive until the file is written.
+    void Save(IndexCacheWriter& writer) const;
+
+    // The closest symbol at or before `address`, if any. Callers decide whether it's close enough.
+    bool SymbolAt(uint64_t address, Symbol& out) const;
+
+    // Every symbol named exactly `name`; an exported name can show up in several images.
+    std::vector<Symbol> SymbolsNamed(std::string_view name) const;
+
+    size_t Size() const { return m_entryCount; };
+};
+
+
+#endif //KSUITE_SYMBOLINDEX_H
@@ -0,0 +1,271 @@
+/*
+ * End to end checks of the core against synthetic caches: mapping every layout, the image table, the address and
+ *  symbol indexes, and slid ObjC pointers.
+ *
+ * usage: sharedcachecore_tests <regular|split|large|ios16|noslide|missing|indexcache|leb128> <scratch directory>
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include "CacheSession.h"
+#include "IndexCache.h"
+#include "SyntheticCache.h"
+
+
+static int s_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_failures++; \
+        } \
+    } while (0)
+
+#define REQUIRE(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            return 1; \
+        } \
+    } while (0)
+
+
+static bool Within(const CacheSection* section, uint64_t address)
+{
+    return section && address >= section->start && address < section->end;
+}
+
+
+// Image `i`'s exports, locals and ObjC metadata, against where the generator lays them out.
+static void CheckImage(CacheSession& session, SymbolIndex* index, const SyntheticCacheOptions& options, uint32_t i,
+                       bool locals)
+{
+    const auto& image = session.Images()[i];
+    CHECK(image.installName == "/usr/lib/libsynth" + std::to_string(i) + ".dylib");
+
+    auto segment = session.SegmentAt(image.headerAddress);
+    CHECK(segment && segment->imageIndex == i && segment->imageCount == 1 && std::string(segment->name) == "__TEXT");
+
+    // Each subcache's images all name the same __LINKEDIT, so no image owns it.
+    auto vm = session.GetVM();
+    uint64_t command = image.headerAddress + 32;
+    for (uint32_t c = 0, ncmds = vm->ReadUInt32(image.headerAddress + 16); c < ncmds; c++)
+    {
+        if (vm->ReadUInt32(command) == 0x19 && vm->ReadNullTermString(command + 8) == "__LINKEDIT")
+        {
+            auto linkedit = session.SegmentAt(vm->ReadULong(command + 24));
+            CHECK(linkedit && std::string(linkedit->name) == "__LINKEDIT" && linkedit->imageCount > 1);
+        }
+        command += vm->ReadUInt32(command + 4);
+    }
+
+    auto text = session.SectionNamed(i, "__TEXT", "__text");
+    CHECK(text != nullptr);
+    if (!text)
+        return;
+    CHECK(vm->ReadUInt32(text->start) == 0xd65f03c0);
+    auto section = session.SectionAt(text->start + 4);
+    CHECK(section == text && section->imageCount == 1);
+
+    if (index)
+    {
+        uint32_t exportIndex = options.exportsPerImage - 1;
+        uint64_t expected = text->start + 4 * (uint64_t)exportIndex;
+        auto hits = index->SymbolsNamed("_synth" + std::to_string(i) + "_func" + std::to_string(exportIndex));
+        CHECK(hits.size() == 1 && hits[0].address == expected && hits[0].imageIndex == i);
+
+        SymbolIndex::Symbol symbol;
+        CHECK(index->SymbolAt(expected, symbol) && symbol.imageIndex == i);
+
+        auto local = index->SymbolsNamed("_synth" + std::to_string(i) + "_local0");
+        uint64_t localAddress = text->start
+                                + 4 * ((uint64_t)options.exportsPerImage + options.classesPerImage * options.methodsPerClass);
+        if (locals)
+            CHECK(local.size() == 1 && local[0].address == localAddress);
+        else
+            CHECK(local.empty());
+    }
+
+    auto classList = session.SectionNamed(i, "__DATA", "__objc_classlist");
+    auto classes = session.SectionNamed(i, "__DATA", "__objc_data");
+    auto constData = session.SectionNamed(i, "__DATA", "__objc_const");
+    CHECK(classList && classList->end - classList->start == 8 * (uint64_t)options.classesPerImage);
+    if (!classList)
+        return;
+    for (uint32_t c = 0; c < options.classesPerImage; c++)
+    {
+        // Every pointer here goes through slide info, if the cache has any.
+        uint64_t cls = vm->ReadULong(classList->start + 8 * c);
+        CHECK(Within(classes, cls));
+        uint64_t ro = vm->ReadULong(cls + 32) & 0x7ffffffffff8;
+        CHECK(Within(constData, ro));
+        if (!Within(constData, ro))
+            continue;
+        CHECK(vm->ReadNullTermString(vm->ReadULong(ro + 24)) == "SynthClass" + std::to_string(i) + "_" + std::to_string(c));
+
+        uint64_t methods = vm->ReadULong(ro + 32);
+        CHECK(vm->ReadUInt32(methods) == (12 | 0x80000000) && vm->ReadUInt32(methods + 4) == options.methodsPerClass);
+        uint64_t entry = methods + 8;
+        uint64_t selector = vm->ReadULong(entry + vm->ReadInt32(entry));
+        CHECK(vm->ReadNullTermString(selector) == "synthMethod0");
+        uint64_t imp = entry + 8 + vm->ReadInt32(entry + 8);
+        CHECK(imp == text->start + 4 * ((uint64_t)options.exportsPerImage + (uint64_t)c * options.methodsPerClass));
+    }
+}
+
+
+// LEB128s that run from one VM region into the next, which the reader has to decode across its windows.
+static int CheckLEB128(const std::string& directory)
+{
+    std::string path = directory + "/leb128";
+    std::string contents(0x4000, '\0');
+    contents[0x1ffe] = (char)0xe5; // ULEB 624485, VM 0x10ffe
+    contents[0x1fff] = (char)0x8e;
+    contents[0x3000] = (char)0x26;
+    contents[0x3fff] = (char)0xc0; // SLEB -123456, VM 0x11fff
+    contents[0x0000] = (char)0xbb;
+    contents[0x0001] = (char)0x78;
+    std::ofstream(path, std::ios::binary).write(contents.data(), contents.size());
+
+    auto file = std::make_shared<MMappedFileAccessor>(path);
+    auto vm = std::make_shared<VM>(0x1000);
+    vm->MapPages(0x10000, 0x1000, 0x1000, file);
+    vm->MapPages(0x11000, 0x3000, 0x1000, file);
+    vm->MapPages(0x12000, 0x0000, 0x1000, file);
+
+    VMReader reader(vm);
+    reader.Seek(0x10ffe);
+    CHECK(reader.ReadULEB128(0x13000) == 624485 && reader.Offset() == 0x11001);
+    reader.Seek(0x11fff);
+    CHECK(reader.ReadSLEB128(0x13000) == -123456 && reader.Offset() == 0x12002);
+    // The limit still applies across windows.
+    reader.Seek(0x10ffe);
+    CHECK(reader.ReadULEB128(0x11000) == (uint64_t)-1 && reader.Offset() == 0x10ffe);
+
+    file.reset();
+    vm.reset();
+    remove(path.c_str());
+    return s_failures ? 1 : 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <regular|split|large|ios16|noslide|missing|indexcache|leb128> <scratch directory>\n", argv[0]);
+        return 2;
+    }
+    std::string mode = argv[1];
+    std::string directory = std::string(argv[2]) + "/" + mode;
+    mkdir(argv[2], 0755);
+    mkdir(directory.c_str(), 0755);
+    if (mode == "leb128")
+        return CheckLEB128(directory);
+
+    SyntheticCacheOptions options;
+    options.imageCount = 24;
+    options.subCacheCount = 3;
+    options.exportsPerImage = 200;
+    options.classesPerImage = 12;
+    options.methodsPerClass = 6;
+    options.localsPerImage = 10;
+    if (mode == "regular")
+        options.format = RegularCacheFormat;
+    else if (mode == "split" || mode == "missing")
+        options.format = SplitCacheFormat;
+    else if (mode == "large")
+        options.format = LargeCacheFormat;
+    else if (mode == "ios16" || mode == "indexcache")
+        options.format = iOS16CacheFormat;
+    else if (mode == "noslide")
+        options.slideInfo = false;
+    else
+    {
+        fprintf(stderr, "unknown mode %s\n", mode.c_str());
+        return 2;
+    }
+
+    std::string path = directory + "/dyld_shared_cache_arm64e";
+    std::vector<std::string> files;
+    try {
+        files = SyntheticCache::Write(path, options);
+    }
+    catch (std::exception& e)
+    {
+        fprintf(stderr, "couldn't write the cache: %s\n", e.what());
+        return 1;
+    }
+
+    // Images in a missing subcache are unreadable, but the rest of the cache still has to work.
+    uint32_t missingFirst = options.imageCount, missingEnd = options.imageCount;
+    if (mode == "missing")
+    {
+        REQUIRE(remove((path + ".2").c_str()) == 0);
+        missingFirst = options.imageCount * 2 / 4;
+        missingEnd = options.imageCount * 3 / 4;
+    }
+
+    // Save a sidecar, then damage its first image's __TEXT entry; the session has to notice and rebuild.
+    if (mode == "indexcache")
+    {
+        IndexCacheFile::SetDirectory(directory);
+        auto first = CacheSession::Acquire(path);
+        REQUIRE(first != nullptr && first->GetSymbolIndex() != nullptr);
+        auto segment = first->SegmentAt(first->Images()[0].headerAddress);
+        REQUIRE(segment != nullptr);
+        CacheSegment damaged = *segment;
+        std::string sidecar = IndexCacheFile::PathForCache(first->UUID());
+        first.reset();
+
+        std::ifstream in(sidecar, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        auto at = contents.find(std::string((const char*)&damaged, sizeof(damaged)));
+        REQUIRE(at != std::string::npos);
+        damaged.imageIndex = 0xffffffff;
+        memcpy(&contents[at], &damaged, sizeof(damaged));
+        std::ofstream(sidecar, std::ios::binary).write(contents.data(), contents.size());
+        files.push_back(sidecar);
+    }
+
+    // Dropping a session mid-build has to cancel it rather than crash or hang.
+    if (auto throwaway = CacheSession::Acquire(path))
+        throwaway->BuildSymbolIndexInBackground();
+
+    auto session = CacheSession::Acquire(path);
+    REQUIRE(session != nullptr);
+    CHECK(session->Format() == options.format);
+    REQUIRE(session->Images().size() == options.imageCount);
+    CHECK(CacheSession::Acquire(path) == session);
+
+    bool locals = options.format != LargeCacheFormat;
+    CHECK((session->LocalSymbolsFile() != nullptr) == (options.format == SplitCacheFormat || options.format == iOS16CacheFormat));
+
+    auto index = session->GetSymbolIndex();
+    REQUIRE(index != nullptr);
+    size_t readableImages = options.imageCount - (missingEnd - missingFirst);
+    CHECK(index->Size() >= readableImages * options.exportsPerImage);
+
+    for (uint32_t i = 0; i < options.imageCount; i++)
+    {
+        if (i >= missingFirst && i < missingEnd)
+        {
+            CHECK(session->SegmentAt(session->Images()[i].headerAddress) == nullptr);
+            continue;
+        }
+        CheckImage(*session, index.get(), options, i, locals);
+    }
+
+    for (const auto& file : files)
+        remove(file.c_str());
+
+    if (s_failures)
+        fprintf(stderr, "%s: %d checks failed\n", mode.c_str(), s_failures);
+    return s_failures ? 1 : 0;
+}
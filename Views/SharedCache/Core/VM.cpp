@@ -0,0 +1,632 @@
+//
+// Created by kat on 5/23/23.
+//
+
+#include "VM.h"
+#include "Log.h"
+#include <filesystem>
+#include <utility>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+
+static size_t SystemPageSize() {
+    static const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+
+void MMAP::Map(bool populate) {
+    struct stat st{};
+    mapped = false;
+    _mmap = nullptr;
+    len = 0;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        return;
+    len = (size_t) st.st_size;
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate && len <= PopulateLimit)
+        flags |= MAP_POPULATE;
+#endif
+    void *result = mmap(nullptr, len, PROT_READ, flags, fd, 0u);
+    if (result == MAP_FAILED) {
+        len = 0;
+        return;
+    }
+    _mmap = result;
+    mapped = true;
+}
+
+
+void MMAP::Unmap() {
+    if (mapped)
+        munmap(_mmap, len);
+    mapped = false;
+}
+
+
+MMappedFileAccessor::MMappedFileAccessor(std::string &path, bool populate) : m_path(path) {
+    m_mmap.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_mmap.fd < 0) {
+        throw MissingFileException();
+    }
+    m_mmap.Map(populate);
+    if (!m_mmap.mapped) {
+        close(m_mmap.fd);
+        throw MissingFileException();
+    }
+}
+
+MMappedFileAccessor::~MMappedFileAccessor() {
+    m_mmap.Unmap();
+    close(m_mmap.fd);
+}
+
+
+void MMappedFileAccessor::Advise(size_t offset, size_t length, Advice advice) const {
+    if (offset >= m_mmap.len || length == 0)
+        return;
+    length = std::min(length, m_mmap.len - offset);
+    // madvise wants a page aligned start; widening the range by a partial page is harmless.
+    size_t start = offset & ~(SystemPageSize() - 1);
+    length += offset - start;
+
+    int flag = MADV_NORMAL;
+    switch (advice) {
+        case AdviseNormal: flag = MADV_NORMAL; break;
+        case AdviseRandom: flag = MADV_RANDOM; break;
+        case AdviseSequential: flag = MADV_SEQUENTIAL; break;
+        case AdviseWillNeed: flag = MADV_WILLNEED; break;
+    }
+    madvise((uint8_t *) m_mmap._mmap + start, length, flag);
+}
+
+
+bool MMappedFileAccessor::MakeWritable(size_t offset, size_t length) {
+    if (offset >= m_mmap.len || length == 0)
+        return true;
+    length = std::min(length, m_mmap.len - offset);
+    size_t start = offset & ~(SystemPageSize() - 1);
+    length += offset - start;
+    return mprotect((uint8_t *) m_mmap._mmap + start, length, PROT_READ | PROT_WRITE) == 0;
+}
+
+std::string MMappedFileAccessor::ReadNullTermString(size_t address) {
+    if (address > m_mmap.len)
+        return "";
+    return {(char *) (&((uint8_t *) m_mmap._mmap)[address])};
+}
+
+uint8_t MMappedFileAccessor::ReadUChar(size_t address) {
+    return ((uint8_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+int8_t MMappedFileAccessor::ReadChar(size_t address) {
+    return ((int8_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+uint16_t MMappedFileAccessor::ReadUShort(size_t address) {
+    return ((uint16_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+int16_t MMappedFileAccessor::ReadShort(size_t address) {
+    return ((int16_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+uint32_t MMappedFileAccessor::ReadUInt32(size_t address) {
+    return ((uint32_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+int32_t MMappedFileAccessor::ReadInt32(size_t address) {
+    return ((int32_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+uint64_t MMappedFileAccessor::ReadULong(size_t address) {
+    return ((uint64_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+int64_t MMappedFileAccessor::ReadLong(size_t address) {
+    return ((int64_t *) (&(((uint8_t *) m_mmap._mmap)[address])))[0];
+}
+
+void MMappedFileAccessor::Read(void *dest, size_t address, size_t length) {
+    size_t max = m_mmap.len;
+    // Nothing to copy; dest may be null here (an empty vector's data()), which memcpy doesn't allow even for 0 bytes.
+    if (address >= max || !length)
+        return;
+    length = std::min(length, max - address);
+    memcpy(dest, (void *) &(((uint8_t *) m_mmap._mmap)[address]), length);
+}
+
+
+VM::VM(size_t pageSize, bool safe) : m_pageSize(pageSize), m_safe(safe) {
+    unsigned bits, var = (m_pageSize - 1 < 0) ? -(m_pageSize - 1) : m_pageSize - 1;
+    for (bits = 0; var != 0; ++bits) var >>= 1;
+    m_pageSizeBits = bits;
+}
+
+VM::~VM() {
+    m_regions.clear();
+    m_fileSlides.clear();
+    m_fileData.clear();
+    m_files.clear();
+}
+
+
+uint32_t VM::FileIndex(const std::shared_ptr<MMappedFileAccessor>& file) {
+    // There are only ever a few dozen files in a cache, a linear scan is cheaper than hashing here.
+    for (uint32_t i = 0; i < m_files.size(); i++)
+        if (m_files[i] == file)
+            return i;
+    m_files.push_back(file);
+    m_fileData.push_back((const uint8_t *) file->Data());
+    m_fileSlides.emplace_back();
+    return (uint32_t) (m_files.size() - 1);
+}
+
+
+void VM::MapPages(size_t vm_address, size_t fileoff, size_t size, std::shared_ptr<MMappedFileAccessor> file) {
+    // The mappings provided for shared caches will always be page aligned.
+    // Rather than a page -> file offset table (which is millions of entries on a modern cache),
+    //      we store each mapping as a single region and binary search them on lookup.
+
+    if (vm_address % m_pageSize != 0 || size % m_pageSize != 0) {
+        throw MappingPageAlignmentException();
+    }
+    if (size == 0)
+        return;
+
+    VMRegion region = {
+        .start = vm_address,
+        .end = vm_address + size,
+        .fileOffset = fileoff,
+        .fileIndex = FileIndex(file)
+    };
+
+    // First region starting at or after our end; anything overlapping us sits directly before it.
+    auto it = std::lower_bound(m_regions.begin(), m_regions.end(), region.end,
+                               [](const VMRegion& r, size_t addr) { return r.start < addr; });
+
+    if (it != m_regions.begin() && std::prev(it)->end > region.start) {
+        if (m_safe) {
+            CoreLogWarn("Remapping page 0x%zx (a: 0x%zx, f: 0x%zx)", std::max(std::prev(it)->start, region.start) >> m_pageSizeBits, vm_address, fileoff);
+            throw MappingCollisionException();
+        }
+        // Unsafe VMs let the newest mapping win, same as the old page table did.
+        // Trim or split whatever we overlap so the table stays sorted and disjoint.
+        std::vector<VMRegion> kept;
+        auto first = it;
+        while (first != m_regions.begin() && std::prev(first)->end > region.start)
+            --first;
+        for (auto cur = first; cur != it; ++cur) {
+            if (cur->start < region.start) {
+                VMRegion head = *cur;
+                head.end = region.start;
+                kept.push_back(head);
+            }
+            if (cur->end > region.end) {
+                VMRegion tail = *cur;
+                tail.fileOffset += region.end - cur->start;
+                tail.start = region.end;
+                kept.push_back(tail);
+            }
+        }
+        auto index = m_regions.erase(first, it) - m_regions.begin();
+        m_regions.insert(m_regions.begin() + index, kept.begin(), kept.end());
+        it = std::lower_bound(m_regions.begin(), m_regions.end(), region.end,
+                              [](const VMRegion& r, size_t addr) { return r.start < addr; });
+    }
+
+    // Coalesce with the previous region if we continue it in the same file.
+    if (it != m_regions.begin()) {
+        auto prev = std::prev(it);
+        if (prev->end == region.start && prev->fileIndex == region.fileIndex
+            && prev->fileOffset + (prev->end - prev->start) == region.fileOffset) {
+            prev->end = region.end;
+            return;
+        }
+    }
+
+    m_regions.insert(it, region);
+}
+
+
+const VMRegion* VM::RegionAtAddress(size_t address) const {
+    // First region starting past the address; the one before it is the only candidate.
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+                               [](size_t addr, const VMRegion& r) { return addr < r.start; });
+    if (it == m_regions.begin())
+        return nullptr;
+    --it;
+    if (address >= it->end)
+        return nullptr;
+    return &*it;
+}
+
+
+std::pair<PageMapping, size_t> VM::MappingAtAddress(size_t address) {
+    if (auto region = RegionAtAddress(address)) {
+        // The PageMapping object returned contains the page, and more importantly, the file pointer (there can be multiple in newer caches)
+        // This is relevant for reading out the data in the rest of this file.
+        // The second item in this pair is the file offset of the address itself.
+        size_t offsetInRegion = address - region->start;
+        size_t pageOffset = region->fileOffset + (offsetInRegion & ~(m_pageSize - 1));
+        return {{
+            .file = m_files[region->fileIndex],
+            .fileOffset = pageOffset,
+            .pagesRemaining = (region->end - (address & ~(m_pageSize - 1))) >> m_pageSizeBits
+        }, region->fileOffset + offsetInRegion};
+    }
+    throw MappingReadException();
+}
+
+
+bool VM::AddressIsMapped(uint64_t address) {
+    return RegionAtAddress(address) != nullptr;
+}
+
+
+void VM::Prefetch(size_t address, size_t length, MMappedFileAccessor::Advice advice) const {
+    size_t end = address + length;
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+                               [](size_t addr, const VMRegion& r) { return addr < r.start; });
+    if (it != m_regions.begin())
+        --it;
+    for (; it != m_regions.end() && it->start < end; ++it) {
+        size_t start = std::max(it->start, address);
+        if (start >= it->end)
+            continue;
+        size_t stop = std::min(it->end, end);
+        m_files[it->fileIndex]->Advise(it->fileOffset + (start - it->start), stop - start, advice);
+    }
+}
+
+
+void VM::AddSlideInfo(std::shared_ptr<MMappedFileAccessor> file, std::shared_ptr<SlideInfo> slideInfo) {
+    m_fileSlides[FileIndex(file)].push_back(std::move(slideInfo));
+}
+
+
+const uint8_t* VM::ResolveAddress(size_t address, size_t* available) const noexcept {
+    auto region = RegionAtAddress(address);
+    if (!region)
+        return nullptr;
+    size_t fileOffset = region->fileOffset + (address - region->start);
+    size_t regionAvailable = region->end - address;
+    for (const auto& slide : m_fileSlides[region->fileIndex]) {
+        if (slide->Contains(fileOffset)) {
+            slide->EnsureSlid(fileOffset);
+            regionAvailable = std::min(regionAvailable, slide->PageEnd(fileOffset) - fileOffset);
+            break;
+        }
+    }
+    if (available)
+        *available = regionAvailable;
+    return m_fileData[region->fileIndex] + fileOffset;
+}
+
+
+std::string VM::ReadNullTermString(size_t address) {
+    size_t available;
+    auto data = ResolveAddress(address, &available);
+    if (!data)
+        throw MappingReadException();
+    size_t length = strnlen((const char *) data, available);
+    if (length < available)
+        return {(const char *) data, length};
+
+    // Ran into the end of a slid page or region before the terminator; keep going chunk by chunk.
+    std::string result((const char *) data, length);
+    while ((data = ResolveAddress(address + result.size(), &available))) {
+        length = strnlen((const char *) data, available);
+        result.append((const char *) data, length);
+        if (length < available)
+            break;
+    }
+    return result;
+}
+
+uint8_t VM::ReadUChar(size_t address) {
+    return ReadValue<uint8_t>(address);
+}
+
+int8_t VM::ReadChar(size_t address) {
+    return ReadValue<int8_t>(address);
+}
+
+uint16_t VM::ReadUShort(size_t address) {
+    return ReadValue<uint16_t>(address);
+}
+
+int16_t VM::ReadShort(size_t address) {
+    return ReadValue<int16_t>(address);
+}
+
+uint32_t VM::ReadUInt32(size_t address) {
+    return ReadValue<uint32_t>(address);
+}
+
+int32_t VM::ReadInt32(size_t address) {
+    return ReadValue<int32_t>(address);
+}
+
+uint64_t VM::ReadULong(size_t address) {
+    return ReadValue<uint64_t>(address);
+}
+
+int64_t VM::ReadLong(size_t address) {
+    return ReadValue<int64_t>(address);
+}
+
+size_t VM::ReadV(size_t address, size_t length, std::vector<VMExtent>& extents) const {
+    // Each resolve stops at a region or slid page boundary, so this walks the range one file-contiguous piece at a time.
+    size_t covered = 0;
+    while (covered < length) {
+        size_t available;
+        auto data = ResolveAddress(address + covered, &available);
+        if (!data)
+            break;
+        size_t chunk = std::min(available, length - covered);
+        if (!extents.empty() && extents.back().address + extents.back().length == address + covered
+            && extents.back().data + extents.back().length == data)
+            extents.back().length += chunk;
+        else
+            extents.push_back({address + covered, data, chunk});
+        covered += chunk;
+    }
+    return covered;
+}
+
+
+const uint8_t* VM::Span(size_t address, size_t length) const noexcept {
+    size_t available;
+    auto data = ResolveAddress(address, &available);
+    if (!data)
+        return nullptr;
+    if (available >= length)
+        return data;
+
+    // Slid pages are resolved one at a time; the range may still be contiguous past the first one.
+    size_t covered = available;
+    while (covered < length) {
+        auto next = ResolveAddress(address + covered, &available);
+        if (next != data + covered)
+            return nullptr;
+        covered += available;
+    }
+    return data;
+}
+
+
+void VM::Read(void *dest, size_t addr, size_t length) {
+    // Nearly every read fits in one resolved piece; this is hot enough that it shouldn't allocate.
+    size_t available;
+    auto data = ResolveAddress(addr, &available);
+    if (!data)
+        throw MappingReadException();
+    if (available >= length) {
+        memcpy(dest, data, length);
+        return;
+    }
+
+    // One memcpy per piece, so reads crossing into another subcache or a slid page get the right bytes.
+    auto out = (uint8_t *) dest;
+    size_t covered = 0;
+    while (true) {
+        size_t chunk = std::min(available, length - covered);
+        memcpy(out + covered, data, chunk);
+        covered += chunk;
+        if (covered == length)
+            return;
+        data = ResolveAddress(addr + covered, &available);
+        if (!data)
+            throw MappingReadException();
+    }
+}
+
+
+VMReader::VMReader(std::shared_ptr<VM> vm, size_t addressSize) : m_vm(vm), m_cursor(0), m_addressSize(addressSize) {
+}
+
+
+const uint8_t* VMReader::Window(size_t address, size_t* available) {
+    if (address >= m_windowStart && address < m_windowEnd) {
+        *available = m_windowEnd - address;
+        return m_window + (address - m_windowStart);
+    }
+    auto data = m_vm->ResolveAddress(address, available);
+    if (!data)
+        return nullptr;
+    m_window = data;
+    m_windowStart = address;
+    m_windowEnd = address + *available;
+    return data;
+}
+
+
+void VMReader::Seek(size_t address) {
+    m_cursor = address;
+}
+
+void VMReader::SeekRelative(size_t offset) {
+    m_cursor += offset;
+}
+
+std::string VMReader::ReadNullTermString(size_t address) {
+    size_t available;
+    auto data = Window(address, &available);
+    if (!data)
+        throw MappingReadException();
+    size_t length = strnlen((const char *) data, available);
+    if (length < available)
+        return {(const char *) data, length};
+    return m_vm->ReadNullTermString(address);
+}
+
+
+// An encoding can run past the end of a region or slid page, so both decoders move on to the next window when
+//  they reach the end of one before `limit`.
+uint64_t VMReader::ReadULEB128(size_t limit) {
+    uint64_t result = 0;
+    int bit = 0;
+    size_t cursor = m_cursor;
+    const uint8_t* cur = nullptr;
+    const uint8_t* end = nullptr;
+    uint8_t byte;
+    do {
+        if (cursor >= limit || bit > 63)
+            return -1;
+        if (cur == end) {
+            size_t available;
+            cur = Window(cursor, &available);
+            if (!cur)
+                return -1;
+            end = cur + std::min(available, limit - cursor);
+        }
+        byte = *cur++;
+        cursor++;
+        result |= ((uint64_t) (byte & 0x7f)) << bit;
+        bit += 7;
+    } while (byte & 0x80);
+    m_cursor = cursor;
+    return result;
+}
+
+
+int64_t VMReader::ReadSLEB128(size_t limit) {
+    int64_t value = 0;
+    size_t shift = 0;
+    size_t cursor = m_cursor;
+    const uint8_t* cur = nullptr;
+    const uint8_t* end = nullptr;
+    while (cursor < limit && shift < 64) {
+        if (cur == end) {
+            size_t available;
+            cur = Window(cursor, &available);
+            if (!cur)
+                break;
+            end = cur + std::min(available, limit - cursor);
+        }
+        uint8_t byte = *cur++;
+        cursor++;
+        value |= ((int64_t) (byte & 0x7f)) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    if (shift && shift < 64)
+        value = (value << (64 - shift)) >> (64 - shift);
+    m_cursor = cursor;
+    return value;
+}
+
+uint8_t VMReader::ReadUChar(size_t address) {
+    return ReadValue<uint8_t>(address);
+}
+
+int8_t VMReader::ReadChar(size_t address) {
+    return ReadValue<int8_t>(address);
+}
+
+uint16_t VMReader::ReadUShort(size_t address) {
+    return ReadValue<uint16_t>(address);
+}
+
+int16_t VMReader::ReadShort(size_t address) {
+    return ReadValue<int16_t>(address);
+}
+
+uint32_t VMReader::ReadUInt32(size_t address) {
+    return ReadValue<uint32_t>(address);
+}
+
+int32_t VMReader::ReadInt32(size_t address) {
+    return ReadValue<int32_t>(address);
+}
+
+uint64_t VMReader::ReadULong(size_t address) {
+    return ReadValue<uint64_t>(address);
+}
+
+int64_t VMReader::ReadLong(size_t address) {
+    return ReadValue<int64_t>(address);
+}
+
+
+size_t VMReader::ReadPointer(size_t address) {
+    if (m_addressSize == 8)
+        return ReadULong(address);
+    else if (m_addressSize == 4)
+        return ReadUInt32(address);
+
+    // no idea what horrible arch we have, should probably die here.
+    return 0;
+}
+
+
+size_t VMReader::ReadPointer() {
+    if (m_addressSize == 8)
+        return ReadULong();
+    else if (m_addressSize == 4)
+        return ReadUInt32();
+
+    return 0;
+}
+
+void VMReader::Read(void *dest, size_t length) {
+    Read(dest, m_cursor, length);
+}
+
+void VMReader::Read(void *dest, size_t addr, size_t length) {
+    size_t available;
+    auto data = Window(addr, &available);
+    if (!data)
+        throw MappingReadException();
+    if (available >= length)
+        memcpy(dest, data, length);
+    else
+        m_vm->Read(dest, addr, length);
+    m_cursor = addr + length;
+}
+
+
+uint8_t VMReader::ReadUChar() {
+    return ReadValue<uint8_t>(m_cursor);
+}
+
+int8_t VMReader::ReadChar() {
+    return ReadValue<int8_t>(m_cursor);
+}
+
+uint16_t VMReader::ReadUShort() {
+    return ReadValue<uint16_t>(m_cursor);
+}
+
+int16_t VMReader::ReadShort() {
+    return ReadValue<int16_t>(m_cursor);
+}
+
+uint32_t VMReader::ReadUInt32() {
+    return ReadValue<uint32_t>(m_cursor);
+}
+
+int32_t VMReader::ReadInt32() {
+    return ReadValue<int32_t>(m_cursor);
+}
+
+uint64_t VMReader::ReadULong() {
+    return ReadValue<uint64_t>(m_cursor);
+}
+
+int64_t VMReader::ReadLong() {
+    return ReadValue<int64_t>(m_cursor);
+}
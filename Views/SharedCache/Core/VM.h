@@ -0,0 +1,348 @@
+//
+// Created by kat on 5/23/23.
+//
+
+#ifndef KSUITE_VM_H
+#define KSUITE_VM_H
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SlideInfo.h"
+
+
+class MissingFileException : public std::exception
+{
+    virtual const char* what() const throw()
+    {
+        return "Missing File.";
+    }
+};
+
+
+
+class MemoryException : public std::exception {
+    virtual const char *what() const throw() {
+        return "Memory Limit Reached";
+    }
+};
+
+
+/*
+ * A read-only, private mapping of a whole cache file.
+ *
+ * Nothing writes to cache files except slide info, which makes just its own mappings writable (copy on write)
+ *  before rebasing into them.
+ */
+struct MMAP {
+    void *_mmap;
+    int fd;
+    size_t len;
+
+    bool mapped;
+
+    // Files at most this big are faulted in up front when asked to, rather than a page at a time.
+    static constexpr size_t PopulateLimit = 64 * 1024 * 1024;
+
+    void Map(bool populate);
+
+    void Unmap();
+};
+
+
+class MMappedFileAccessor {
+    std::string m_path;
+    MMAP m_mmap;
+
+public:
+
+    // Access pattern hints for ranges of the file, see Advise.
+    enum Advice {
+        AdviseNormal,
+        AdviseRandom,     // tries, __LINKEDIT, local symbols: scattered small reads, readahead is wasted
+        AdviseSequential, // read front to back once
+        AdviseWillNeed,   // about to be read, start paging it in now
+    };
+
+    // `populate` pre-faults the whole file if it's no bigger than MMAP::PopulateLimit (where supported).
+    MMappedFileAccessor(std::string &path, bool populate = false);
+
+    ~MMappedFileAccessor();
+
+    std::string Path() const { return m_path; };
+
+    size_t Length() const { return m_mmap.len; };
+
+    void *Data() const { return m_mmap._mmap; };
+
+    // Hints the kernel about how [offset, offset + length) is going to be read. Purely advisory.
+    void Advise(size_t offset, size_t length, Advice advice) const;
+
+    // Makes [offset, offset + length) writable. Writes stay private to this process. False if the kernel refused.
+    bool MakeWritable(size_t offset, size_t length);
+
+    std::string ReadNullTermString(size_t address);
+
+    uint8_t ReadUChar(size_t address);
+
+    int8_t ReadChar(size_t address);
+
+    uint16_t ReadUShort(size_t address);
+
+    int16_t ReadShort(size_t address);
+
+    uint32_t ReadUInt32(size_t address);
+
+    int32_t ReadInt32(size_t address);
+
+    uint64_t ReadULong(size_t address);
+
+    int64_t ReadLong(size_t address);
+
+    void Read(void *dest, size_t addr, size_t length);
+};
+
+
+struct PageMapping {
+    std::shared_ptr<MMappedFileAccessor> file;
+    size_t fileOffset;
+    size_t pagesRemaining;
+};
+
+
+/*
+ * A contiguous run of pages backed by a single contiguous range of one file.
+ *
+ * Shared cache mappings are always page aligned and contiguous on disk, so a whole
+ * dyld_cache_mapping_info collapses into one of these instead of one entry per page.
+ */
+struct VMRegion {
+    size_t start;       // first mapped address
+    size_t end;         // one past the last mapped address
+    size_t fileOffset;  // file offset backing `start`
+    uint32_t fileIndex; // index into VM::m_files
+};
+
+
+/*
+ * A run of VM addresses readable straight out of one file mapping: `length` bytes at `data` are `address` onwards.
+ * Only valid for as long as the VM (and so its files) is.
+ */
+struct VMExtent {
+    size_t address;
+    const uint8_t* data;
+    size_t length;
+};
+
+
+class VMException : public std::exception {
+    virtual const char *what() const throw() {
+        return "Generic VM Exception";
+    }
+};
+
+class MappingPageAlignmentException : public VMException {
+    virtual const char *what() const throw() {
+        return "Tried to create a mapping not aligned to given page size";
+    }
+};
+
+class MappingReadException : public VMException {
+    virtual const char *what() const throw() {
+        return "Tried to access unmapped page";
+    }
+};
+
+class MappingCollisionException : public VMException {
+    virtual const char *what() const throw() {
+        return "Tried to remap a page";
+    }
+};
+
+class VMReader;
+
+
+class VM {
+    // Small table of every file backing this VM; regions refer to these by index.
+    std::vector<std::shared_ptr<MMappedFileAccessor>> m_files;
+    // Raw base pointer of each file above, so the read path never touches a shared_ptr.
+    std::vector<const uint8_t*> m_fileData;
+    // Slid mappings within each file above. Empty for most files (__TEXT-only subcaches, .symbols).
+    std::vector<std::vector<std::shared_ptr<SlideInfo>>> m_fileSlides;
+    // Sorted by start address, never overlapping.
+    std::vector<VMRegion> m_regions;
+    size_t m_pageSize;
+    size_t m_pageSizeBits;
+    bool m_safe;
+
+    friend VMReader;
+
+    uint32_t FileIndex(const std::shared_ptr<MMappedFileAccessor>& file);
+
+    const VMRegion* RegionAtAddress(size_t address) const;
+
+public:
+
+    VM(size_t pageSize, bool safe = true);
+
+    ~VM();
+
+    void MapPages(size_t vm_address, size_t fileoff, size_t size, std::shared_ptr<MMappedFileAccessor> file);
+
+    // Registers rebase info for a slid mapping in `file`. Pages covered by it are rebased on first access.
+    void AddSlideInfo(std::shared_ptr<MMappedFileAccessor> file, std::shared_ptr<SlideInfo> slideInfo);
+
+    bool AddressIsMapped(uint64_t address);
+    // One past the highest mapped address; 0 if nothing is mapped.
+    uint64_t MappedEnd() const { return m_regions.empty() ? 0 : m_regions.back().end; };
+
+    /*
+     * Asks for the file pages backing [address, address + length) to be read in ahead of use.
+     * Call before bulk reads of a range; unmapped parts are ignored, and it never slides or blocks.
+     */
+    void Prefetch(size_t address, size_t length, MMappedFileAccessor::Advice advice = MMappedFileAccessor::AdviseWillNeed) const;
+
+    std::pair<PageMapping, size_t> MappingAtAddress(size_t address);
+
+    /*
+     * Fast path for reads.
+     *
+     * Resolves `address` to a pointer into the file backing it, and stores the number of contiguous
+     *  bytes readable from that pointer in `available`.
+     * In slid mappings the page is rebased first, and `available` stops at the end of that page.
+     * Returns nullptr for unmapped addresses. Never throws, allocates, or touches a refcount.
+     */
+    const uint8_t* ResolveAddress(size_t address, size_t* available = nullptr) const noexcept;
+
+    /*
+     * Splits [address, address + length) into extents, each contiguous in one file, appending them to `extents`.
+     * Neighbouring pieces that turn out to be contiguous in memory (e.g. consecutive slid pages) are merged.
+     * Stops at the first unmapped address and returns how many bytes the extents cover. Never throws.
+     */
+    size_t ReadV(size_t address, size_t length, std::vector<VMExtent>& extents) const;
+
+    // Zero-copy view of [address, address + length) if all of it is one contiguous extent, else nullptr.
+    const uint8_t* Span(size_t address, size_t length) const noexcept;
+
+    template <typename T>
+    T ReadValue(size_t address) {
+        size_t available;
+        auto data = ResolveAddress(address, &available);
+        if (!data)
+            throw MappingReadException();
+        T result;
+        if (available >= sizeof(T))
+            memcpy(&result, data, sizeof(T));
+        else
+            Read(&result, address, sizeof(T));
+        return result;
+    }
+
+    std::string ReadNullTermString(size_t address);
+
+    uint8_t ReadUChar(size_t address);
+
+    int8_t ReadChar(size_t address);
+
+    uint16_t ReadUShort(size_t address);
+
+    int16_t ReadShort(size_t address);
+
+    uint32_t ReadUInt32(size_t address);
+
+    int32_t ReadInt32(size_t address);
+
+    uint64_t ReadULong(size_t address);
+
+    int64_t ReadLong(size_t address);
+
+    void Read(void *dest, size_t addr, size_t length);
+};
+
+
+class VMReader {
+    std::shared_ptr<VM> m_vm;
+    size_t m_cursor;
+    size_t m_addressSize;
+
+    // The last contiguous span we resolved; sequential reads are served from here without a region lookup.
+    const uint8_t* m_window = nullptr;
+    size_t m_windowStart = 0;
+    size_t m_windowEnd = 0;
+
+    const uint8_t* Window(size_t address, size_t* available);
+
+    template <typename T>
+    T ReadValue(size_t address) {
+        size_t available;
+        auto data = Window(address, &available);
+        if (!data)
+            throw MappingReadException();
+        T result;
+        if (available >= sizeof(T))
+            memcpy(&result, data, sizeof(T));
+        else
+            m_vm->Read(&result, address, sizeof(T));
+        m_cursor = address + sizeof(T);
+        return result;
+    }
+
+public:
+    VMReader(std::shared_ptr<VM> vm, size_t addressSize = 8);
+
+    void Seek(size_t address);
+
+    void SeekRelative(size_t offset);
+
+    [[nodiscard]] size_t Offset() const { return m_cursor; }
+
+    std::string ReadNullTermString(size_t address);
+
+    uint64_t ReadULEB128(size_t cursorLimit);
+
+    int64_t ReadSLEB128(size_t cursorLimit);
+
+    uint8_t ReadUChar();
+
+    int8_t ReadChar();
+
+    uint16_t ReadUShort();
+
+    int16_t ReadShort();
+
+    uint32_t ReadUInt32();
+
+    int32_t ReadInt32();
+
+    uint64_t ReadULong();
+
+    int64_t ReadLong();
+
+    size_t ReadPointer();
+
+    uint8_t ReadUChar(size_t address);
+
+    int8_t ReadChar(size_t address);
+
+    uint16_t ReadUShort(size_t address);
+
+    int16_t ReadShort(size_t address);
+
+    uint32_t ReadUInt32(size_t address);
+
+    int32_t ReadInt32(size_t address);
+
+    uint64_t ReadULong(size_t address);
+
+    int64_t ReadLong(size_t address);
+
+    size_t ReadPointer(size_t address);
+
+    void Read(void *dest, size_t length);
+
+    void Read(void *dest, size_t addr, size_t length);
+};
+
+#endif //KSUITE_VM_H
@@ -5,6 +5,8 @@
 #include "DSCView.h"
 #include "../MachO/machoview.h"
 #include "LoadedImage.h"
+#include "Core/CacheSession.h"
+#include "SharedCache.h"
 
 using namespace BinaryNinja;
 
@@ -14,11 +16,65 @@ DSCRawView::DSCRawView(const std::string &typeName, BinaryView *data, bool parse
                      data)
 {
     GetFile()->SetFilename(data->GetFile()->GetOriginalFilename());
-    auto reader = new BinaryReader(GetParentView());
-    reader->Seek(16);
-    auto size = reader->Read32();
-    AddAutoSegment(0, size, 0, size, SegmentReadable);
-    GetParentView()->WriteBuffer(0, GetParentView()->ReadBuffer(0, size));
+    m_filename = data->GetFile()->GetOriginalFilename();
+    m_session = CacheSession::Acquire(m_filename);
+    if (m_session)
+    {
+        // mappingOffset comes straight from the file; a truncated cache can put it past the end.
+        m_headerSize = std::min<uint64_t>(m_session->Header().mappingOffset, m_session->BaseFile()->Length());
+        m_length = std::max(m_headerSize, m_session->GetVM()->MappedEnd());
+    }
+}
+
+
+size_t DSCRawView::PerformRead(void *dest, uint64_t offset, size_t len)
+{
+    if (!m_session)
+        return 0;
+
+    if (offset < m_headerSize)
+    {
+        auto baseFile = m_session->BaseFile();
+        size_t available = std::min<uint64_t>(len, m_headerSize - offset);
+        memcpy(dest, (const uint8_t*)baseFile->Data() + offset, available);
+        return available;
+    }
+
+    // Copy what's mapped, stopping short at the first hole.
+    auto vm = m_session->GetVM();
+    if (auto data = vm->Span(offset, len))
+    {
+        memcpy(dest, data, len);
+        return len;
+    }
+
+    std::vector<VMExtent> extents;
+    size_t read = vm->ReadV(offset, len, extents);
+    auto out = (uint8_t*)dest;
+    for (const auto& extent : extents)
+    {
+        memcpy(out, extent.data, extent.length);
+        out += extent.length;
+    }
+    return read;
+}
+
+
+bool DSCRawView::PerformIsValidOffset(uint64_t offset)
+{
+    return offset < m_headerSize || (m_session && m_session->GetVM()->AddressIsMapped(offset));
+}
+
+
+bool DSCRawView::PerformIsOffsetReadable(uint64_t offset)
+{
+    return PerformIsValidOffset(offset);
+}
+
+
+bool DSCRawView::PerformIsOffsetBackedByFile(uint64_t offset)
+{
+    return PerformIsValidOffset(offset);
 }
 
 bool DSCRawView::Init()
@@ -63,13 +119,59 @@ bool DSCRawViewType::IsTypeValidForData(BinaryNinja::BinaryView *data)
 DSCView::DSCView(const std::string &typeName, BinaryView *data, bool parseOnly)
         : BinaryView(typeName,
                      data->GetFile(),
-                     data)
+                     data), m_parseOnly(parseOnly)
 {
     // m_filename = data->GetFile()->GetFilename();
 }
 
+/*
+ * Databases saved before the raw view was addressed by VM address put each loaded segment's data at a cursor past
+ *  the end of the raw view, copying the bytes there. Point those segments back at their VM address and drop the
+ *  copies' segments from the raw view. The JSON state's offsets are fixed up as it's read.
+ */
+static void MigrateLegacySegments(BinaryView* dscView)
+{
+    std::vector<Ref<Segment>> stale;
+    for (const auto& segment : dscView->GetSegments())
+        if (!segment->IsAutoDefined() && segment->GetDataOffset() != segment->GetStart())
+            stale.push_back(segment);
+    if (stale.empty())
+        return;
+
+    LogInfo("Moving %zu segments from an older database to their cache addresses", stale.size());
+    for (const auto& segment : stale)
+    {
+        uint64_t start = segment->GetStart(), length = segment->GetLength();
+        uint32_t flags = segment->GetFlags();
+        dscView->RemoveUserSegment(start, length);
+        dscView->AddUserSegment(start, length, start, length, flags);
+    }
+
+    auto rawView = dscView->GetParentView();
+    for (const auto& segment : rawView->GetSegments())
+        if (!segment->IsAutoDefined())
+            rawView->RemoveUserSegment(segment->GetStart(), segment->GetLength());
+}
+
+
+DSCView::~DSCView()
+{
+    SharedCache::UnregisterView(this);
+}
+
 bool DSCView::Init()
 {
+    m_session = CacheSession::Acquire(GetFile()->GetOriginalFilename());
+    // API calls against this view share one controller from here on. Views made just to read load settings don't,
+    //  and don't start the symbol index either: closing one would wait on that build.
+    if (!m_parseOnly)
+    {
+        // Nothing needs it this early; starting now means it's usually ready by the time someone asks.
+        if (m_session)
+            m_session->BuildSymbolIndexInBackground();
+        SharedCache::RegisterView(this);
+    }
+
     SetDefaultArchitecture(Architecture::GetByName("aarch64"));
     SetDefaultPlatform(Platform::GetByName("mac-aarch64"));
 
@@ -485,51 +587,19 @@ bool DSCView::Init()
     Ref<Type> filesetEntryCommandType = Type::StructureType(filesetEntryCommandStruct);
     DefineType(filesetEntryCommandTypeId, filesetEntryCommandName, filesetEntryCommandType);
 
-    std::vector<LoadedImage> images;
-    if (auto meta = GetParentView()->GetParentView()->QueryMetadata(SharedCacheMetadataTag))
-    {
-        std::string data = GetParentView()->GetParentView()->GetStringMetadata(SharedCacheMetadataTag);
-        BNLogError("%s", data.c_str());
-        std::stringstream ss;
-        ss.str(data);
-        rapidjson::Document result(rapidjson::kObjectType);
-
-        result.Parse(data.c_str());
-        for (auto &imgV: result["loadedImages"].GetArray())
-        {
-            if (imgV.HasMember("name"))
-            {
-                auto name = imgV.FindMember("name");
-                if (name != imgV.MemberEnd())
-                {
-                    LoadedImage img;
-                    img.LoadFromValue(imgV);
-                    images.push_back(img);
-                }
-            }
-        }
-    }
-    else
+    // Loaded image segments are user segments backed by the raw view, so they come back with the database.
+    // A fresh view only needs the cache header.
+    if (!QueryMetadata(SharedCacheStateTag) && !QueryMetadata(SharedCacheMetadataTag)
+        && !GetParentView()->GetParentView()->QueryMetadata(SharedCacheMetadataTag))
     {
-        auto reader = new BinaryReader(GetParentView());
-        reader->Seek(16);
-        auto size = reader->Read32();
-        //WriteBuffer(0, GetParentView()->ReadBuffer(0, size));
+        BinaryReader reader(GetParentView());
+        reader.Seek(16);
+        auto size = reader.Read32();
         AddAutoSegment(0, size, 0, size, SegmentReadable);
-        return true;
     }
-
-    for (auto image : images)
+    else if (!m_parseOnly && !QueryMetadata(SharedCacheStateTag))
     {
-        for (auto seg : image.loadedSegments)
-        {
-            // yeah ok this sucks ass
-            // but is literally the only way
-            // we're in deser, we have to rebuild our parent view as well here
-            GetParentView()->AddUserSegment(seg.first, seg.second.second, seg.first, seg.second.second, SegmentReadable);
-            GetParentView()->WriteBuffer(seg.first, GetParentView()->GetParentView()->ReadBuffer(seg.first, seg.second.second));
-            //AddAutoSegment(seg.second.first, seg.second.second, seg.first, seg.second.second, SegmentReadable | SegmentExecutable);
-        }
+        MigrateLegacySegments(this);
     }
 
     return true;
@@ -551,6 +621,31 @@ BinaryNinja::Ref<BinaryNinja::BinaryView> DSCViewType::Parse(BinaryNinja::Binary
     return new DSCView("DSCView", new DSCRawView("DSCRawView", data, true), true);
 }
 
+BinaryNinja::Ref<BinaryNinja::Settings> DSCViewType::GetLoadSettingsForData(BinaryNinja::BinaryView *data)
+{
+    Ref<BinaryView> viewRef = Parse(data);
+    if (!viewRef || !viewRef->Init())
+    {
+        LogError("View type '%s' could not be created", GetName().c_str());
+        return nullptr;
+    }
+
+    Ref<Settings> settings = GetDefaultLoadSettingsForData(viewRef);
+    settings->RegisterSetting("loader.dsc.segmentLoading",
+            R"({
+            "title" : "Image Segment Loading",
+            "type" : "string",
+            "default" : "lazy",
+            "enum" : ["lazy", "eager"],
+            "enumDescriptions" : [
+                "Add image segments as they are, but only expose the parts of the shared __LINKEDIT each image references.",
+                "Add every image segment under 128MB in full, __LINKEDIT included."],
+            "description" : "How much of each image is added to the view when it is loaded. Segment contents are always read from the cache on demand."
+            })");
+
+    return settings;
+}
+
 bool DSCViewType::IsTypeValidForData(BinaryNinja::BinaryView *data)
 {
     if (!data)
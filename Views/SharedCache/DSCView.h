@@ -7,13 +7,35 @@
 
 #include <binaryninjaapi.h>
 
+class CacheSession;
+
+/*
+ * The cache's VM address space, as a flat view.
+ *
+ * Offsets are VM addresses, and reads are served straight out of the mapped cache files.
+ * DSCView segments map onto this 1:1 (data offset == vmaddr), so loading an image only registers segments.
+ * Below the first mapping we serve the base file itself, so the header is still readable at offset 0.
+ */
 class DSCRawView : public BinaryNinja::BinaryView {
     std::string m_filename;
+    std::shared_ptr<CacheSession> m_session;
+    uint64_t m_headerSize = 0;
+    uint64_t m_length = 0;
+
 public:
 
     DSCRawView(const std::string &typeName, BinaryView *data, bool parseOnly = false);
 
     bool Init() override;
+
+protected:
+    size_t PerformRead(void *dest, uint64_t offset, size_t len) override;
+    bool PerformIsValidOffset(uint64_t offset) override;
+    bool PerformIsOffsetReadable(uint64_t offset) override;
+    bool PerformIsOffsetWritable(uint64_t offset) override { return false; }
+    bool PerformIsOffsetBackedByFile(uint64_t offset) override;
+    uint64_t PerformGetStart() const override { return 0; }
+    uint64_t PerformGetLength() const override { return m_length; }
 };
 
 
@@ -34,10 +56,14 @@ public:
 
 
 class DSCView : public BinaryNinja::BinaryView {
+    // Keeps the mapped cache alive (and shared with every SharedCache controller) until the view closes.
+    std::shared_ptr<CacheSession> m_session;
+    bool m_parseOnly;
 
 public:
 
     DSCView(const std::string &typeName, BinaryView *data, bool parseOnly = false);
+    ~DSCView() override;
 
     bool Init() override;
 };
@@ -56,7 +82,7 @@ public:
 
     bool IsDeprecated() override { return false; }
 
-    BinaryNinja::Ref<BinaryNinja::Settings> GetLoadSettingsForData(BinaryNinja::BinaryView *data) override { return nullptr; }
+    BinaryNinja::Ref<BinaryNinja::Settings> GetLoadSettingsForData(BinaryNinja::BinaryView *data) override;
 };
 
 
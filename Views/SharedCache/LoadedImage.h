@@ -11,11 +11,32 @@
 #include "rapidjson/prettywriter.h"
 #include "libkbinja/MetadataSerializable.hpp"
 
+#include <cstring>
+
+// Legacy JSON state, read when a database has nothing newer.
 const std::string SharedCacheMetadataTag = "KSUITE-SharedCacheData";
+// Binary state: one small header record, then one record per loaded image under its own key, in load order.
+const std::string SharedCacheStateTag = "KSUITE-SharedCacheState";
+const std::string SharedCacheImageTagPrefix = "KSUITE-SharedCacheImage.";
+
+/*
+ * Fixed header of the binary state. Everything is little endian.
+ * Image records are appended as images are loaded, so saving never rewrites what's already stored.
+ */
+struct SharedCacheStateRecord {
+    char magic[4];          // "KDSC"
+    uint16_t version;       // SharedCacheStateVersion
+    uint8_t viewState;
+    uint8_t reserved;
+    uint32_t imageCount;    // records at SharedCacheImageTagPrefix + [0, imageCount)
+};
+
+const uint16_t SharedCacheStateVersion = 1;
 
 struct LoadedImage : public MetadataSerializable {
     std::string name;
     uint64_t headerBase;
+    // (raw view offset, (vm start, vm end)). The raw view is addressed by VM address, so the offset is the vm start.
     std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> loadedSegments;
     std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> loadedSections;
 
@@ -29,5 +50,56 @@ struct LoadedImage : public MetadataSerializable {
         MSL(headerBase);
         MSL(loadedSegments);
     }
+
+    /*
+     * Binary record: u64 headerBase, u32 segment count, u32 name length, (u64 start, u64 end) per segment, name.
+     * A segment's raw view offset is always its start, so it isn't stored.
+     */
+    std::vector<uint8_t> Encode() const
+    {
+        uint32_t segmentCount = (uint32_t)loadedSegments.size();
+        uint32_t nameLength = (uint32_t)name.size();
+        std::vector<uint8_t> data(16 + segmentCount * 16 + nameLength);
+        uint8_t* cursor = data.data();
+        auto put = [&](const void* value, size_t size) {
+            memcpy(cursor, value, size);
+            cursor += size;
+        };
+        put(&headerBase, 8);
+        put(&segmentCount, 4);
+        put(&nameLength, 4);
+        for (const auto& [offset, range] : loadedSegments)
+        {
+            put(&range.first, 8);
+            put(&range.second, 8);
+        }
+        put(name.data(), nameLength);
+        return data;
+    }
+
+    // Returns false (leaving `out` partially filled) if the record is truncated.
+    static bool Decode(const uint8_t* data, size_t size, LoadedImage& out)
+    {
+        uint32_t segmentCount, nameLength;
+        if (size < 16)
+            return false;
+        memcpy(&out.headerBase, data, 8);
+        memcpy(&segmentCount, data + 8, 4);
+        memcpy(&nameLength, data + 12, 4);
+        if (16 + (uint64_t)segmentCount * 16 + nameLength > size)
+            return false;
+
+        const uint8_t* cursor = data + 16;
+        out.loadedSegments.resize(segmentCount);
+        for (auto& [offset, range] : out.loadedSegments)
+        {
+            memcpy(&range.first, cursor, 8);
+            memcpy(&range.second, cursor + 8, 8);
+            offset = range.first;
+            cursor += 16;
+        }
+        out.name.assign((const char*)cursor, nameLength);
+        return true;
+    }
 };
 #endif //KSUITE_LOADEDIMAGE_H
@@ -4,6 +4,7 @@
 //
 
 #include "ObjC.h"
+#include "Core/Parallel.h"
 
 std::pair<QualifiedName, Ref<Type>> FinalizeStructureBuilder(Ref<BinaryView> bv, StructureBuilder sb, std::string name) {
     auto classTypeStruct = sb.Finalize();
@@ -110,11 +111,12 @@ std::vector<std::string> ObjCTypeParser::parseEncodedType(const std::string &enc
 }
 
 ObjCProcessing::ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::shared_ptr<VM> vm) : m_cache(cache), m_dscView(view), m_vm(vm) {
+    m_session = cache->Session();
     m_logger = new Logger("objcLoader");
     m_typesLoaded = false;
     m_customRelativeMethodSelectorBase = std::nullopt;
 
-    auto *reader = new VMReader(vm);
+    VMReader reader(vm);
 
     if (auto addr = m_cache->GetImageStart("/usr/lib/libobjc.A.dylib")) {
         uint64_t scoffs_addr = 0;
@@ -122,13 +124,13 @@ ObjCProcessing::ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::sh
 
         mach_header_64 header{};
 
-        header.magic = reader->ReadUInt32(addr);
-        header.cputype = reader->ReadInt32();
-        header.cpusubtype = reader->ReadInt32();
-        header.filetype = reader->ReadUInt32();
-        header.ncmds = reader->ReadUInt32();
-        header.sizeofcmds = reader->ReadUInt32();
-        header.flags = reader->ReadUInt32();
+        header.magic = reader.ReadUInt32(addr);
+        header.cputype = reader.ReadInt32();
+        header.cpusubtype = reader.ReadInt32();
+        header.filetype = reader.ReadUInt32();
+        header.ncmds = reader.ReadUInt32();
+        header.sizeofcmds = reader.ReadUInt32();
+        header.flags = reader.ReadUInt32();
 
         try {
             size_t loadCommandOffset = 32;
@@ -139,23 +141,23 @@ ObjCProcessing::ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::sh
             for (size_t i = 0; i < header.ncmds; i++) {
                 load_command load{};
                 uint64_t curOffset = cursor;
-                load.cmd = reader->ReadUInt32(cursor);
-                load.cmdsize = reader->ReadUInt32(cursor + 4);
+                load.cmd = reader.ReadUInt32(cursor);
+                load.cmdsize = reader.ReadUInt32(cursor + 4);
                 cursor += 8;
                 uint64_t nextOffset = curOffset + load.cmdsize;
                 switch (load.cmd) {
                     case LC_SEGMENT_64: {
                         segment_command_64 seg{};
-                        reader->Read(&seg, curOffset, sizeof(segment_command_64));
+                        reader.Read(&seg, curOffset, sizeof(segment_command_64));
                         char segmentName[17];
                         strncpy(segmentName, seg.segname, 16);
                         segmentName[16] = 0;
                         cursor += (7 * 8);
-                        size_t numSections = reader->ReadUInt32(cursor);
+                        size_t numSections = reader.ReadUInt32(cursor);
                         cursor += 8;
                         for (size_t j = 0; j < numSections; j++) {
                             section_64 sect{};
-                            reader->Read(&sect, cursor, sizeof(section_64));
+                            reader.Read(&sect, cursor, sizeof(section_64));
                             char sectName[17];
                             char segName[17];
                             strncpy(sectName, sect.sectname, 16);
@@ -165,8 +167,8 @@ ObjCProcessing::ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::sh
                             segName[16] = 0;
 
                             if (std::string(sectName) == "__objc_scoffs") {
-                                size_t vaddr = reader->ReadULong(cursor + 32);
-                                size_t size = reader->ReadULong(cursor + 40);
+                                size_t vaddr = reader.ReadULong(cursor + 32);
+                                size_t size = reader.ReadULong(cursor + 40);
                                 scoffs_addr = vaddr;
                                 scoffs_size = size;
                             }
@@ -185,215 +187,461 @@ ObjCProcessing::ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::sh
 
         if (scoffs_size && scoffs_addr) {
             if (scoffs_size == 0x20) {
-                m_customRelativeMethodSelectorBase = reader->ReadULong(scoffs_addr) & 0xFFFFFFFFF;
+                m_customRelativeMethodSelectorBase = reader.ReadULong(scoffs_addr);
             } else {
-                m_customRelativeMethodSelectorBase = reader->ReadULong(scoffs_addr + 8) & 0xFFFFFFFFF;
+                m_customRelativeMethodSelectorBase = reader.ReadULong(scoffs_addr + 8);
             }
         }
     }
-}
 
+    // Newer caches dropped __objc_scoffs and record the base in their ObjC optimization header instead.
+    if (!m_customRelativeMethodSelectorBase.has_value() && m_session)
+        if (auto opts = m_session->GetObjCOptimizations())
+            m_customRelativeMethodSelectorBase = opts->RelativeMethodSelectorBase();
+}
 
-std::vector<DSCObjC::Class *> ObjCProcessing::GetClassList(KMachOHeader &image) {
-    std::vector<DSCObjC::Class *> classes{};
-    VMReader *reader = new VMReader(m_vm);
-    std::vector<uint64_t> classPtrs;
 
-    if (auto cl = m_dscView->GetSectionByName(image.identifierPrefix + "::__objc_classlist")) {
-        //// BNLogInfo("0x%llx", cl->second.addr);
-        reader->Seek(cl->GetStart());
-        size_t end = cl->GetStart() + cl->GetLength();
-        for (size_t i = cl->GetStart(); i < end; i += 8) {
-            classPtrs.push_back(reader->ReadULong(i) & 0x1ffffffff);
-        }
-    }
-    if (classPtrs.empty())
-        return {};
+std::vector<uint64_t> ObjCProcessing::GetPointerList(KMachOHeader &image, const std::string &sectionName) {
+    std::vector<uint64_t> pointers;
 
-    for (auto cpt: classPtrs) {
-        //// BNLogInfo("0x%llx", cpt);
+    if (auto section = m_dscView->GetSectionByName(image.identifierPrefix + "::" + sectionName)) {
+        pointers.resize(section->GetLength() / 8);
         try {
-            DSCObjC::Class *c = new DSCObjC::Class;
-            DSCObjC::ClassRO *ro = new DSCObjC::ClassRO;
-            c->isa = reader->ReadULong(cpt) & 0x1ffffffff;
-            c->super = reader->ReadULong() & 0x1ffffffff;
-            reader->ReadULong();
-            reader->ReadULong();
-            uint64_t ro_addr = reader->ReadULong() & 0x1ffffffff;
-            if (!m_vm->AddressIsMapped(ro_addr))
-            {
-                ro_addr = ro_addr + reader->Offset()-8;
-            }
-
-            ro->name = (reader->ReadULong(ro_addr + 24)) & 0x1ffffffff;
-            ro->methods = (reader->ReadULong(ro_addr + 32)) & 0x1ffffffff;
-
-            c->ro_data = ro;
-            classes.push_back(c);
+            m_vm->Read(pointers.data(), section->GetStart(), pointers.size() * 8);
         }
         catch (MappingReadException& ex)
         {
-            BNLogError("Failed to load Obj-C Class at 0x%llx", cpt);
+            BNLogError("Failed to read %s for %s", sectionName.c_str(), image.identifierPrefix.c_str());
+            return {};
         }
     }
-    return classes;
+    return pointers;
+}
+
+
+uint64_t ObjCProcessing::ClassROAddress(const DSCObjC::Class &cls, uint64_t addr) {
+    // Low bits of class_t::bits are flags (Swift, RW realized), not part of the class_ro_t address.
+    uint64_t ro_addr = cls.data & 0x00007ffffffffff8;
+    if (!m_vm->AddressIsMapped(ro_addr))
+    {
+        ro_addr = ro_addr + addr + offsetof(DSCObjC::Class, data);
+    }
+    return ro_addr;
+}
+
+
+// Fetches every entry of a method/ivar/property list in one read, and stores the entry size in `entsize`.
+static std::vector<uint8_t> ReadListEntries(VM &vm, uint64_t listAddr, const DSCObjC::ListHeader &header,
+                                            size_t minimumEntsize, size_t &entsize) {
+    entsize = std::max<size_t>(header.entsizeAndFlags & 0xfffc, minimumEntsize);
+    // Nothing real comes close to this; a count this big means we're not looking at a list.
+    if ((uint64_t)header.count * entsize > 0x1000000)
+        throw MappingReadException();
+
+    std::vector<uint8_t> entries(header.count * entsize);
+    vm.Read(entries.data(), listAddr + sizeof(header), entries.size());
+    return entries;
 }
 
 
 std::vector<DSCObjC::Method> ObjCProcessing::LoadMethodList(uint64_t addr) {
-    auto *reader = new VMReader(m_vm);
-    auto flags = reader->ReadUInt32(addr) & 0xffff0000;
+    auto header = ReadStruct<DSCObjC::ListHeader>(addr);
+    auto flags = header.entsizeAndFlags & 0xffff0000;
 
     bool rms = flags & 0x80000000;
     bool direct = flags & 0x40000000;
 
-    auto count = reader->ReadUInt32();
-    std::vector<DSCObjC::Method> methods;
+    size_t entsize;
+    auto entries = ReadListEntries(*m_vm, addr, header, rms ? 12 : sizeof(DSCObjC::Method), entsize);
 
-    for (size_t i = 0; i < count; i++) {
+    std::vector<DSCObjC::Method> methods;
+    methods.reserve(header.count);
+    for (size_t i = 0; i < header.count; i++) {
+        const uint8_t* entry = entries.data() + i * entsize;
         DSCObjC::Method meth{};
         if (rms) {
+            // Relative offsets are from the field they're stored in.
+            uint64_t entryAddr = addr + sizeof(header) + i * entsize;
+            int32_t offsets[3];
+            memcpy(offsets, entry, sizeof(offsets));
+
             if (m_customRelativeMethodSelectorBase.has_value()) {
-                meth.name = m_customRelativeMethodSelectorBase.value() + reader->ReadInt32();
-                meth.types = reader->Offset() + reader->ReadInt32();
-                meth.imp = reader->Offset() + reader->ReadInt32();
+                meth.name = m_customRelativeMethodSelectorBase.value() + offsets[0];
             } else {
-                meth.name = reader->Offset() + reader->ReadInt32();
-                meth.types = reader->Offset() + reader->ReadInt32();
-                meth.imp = reader->Offset() + reader->ReadInt32();
+                meth.name = entryAddr + offsets[0];
             }
+            meth.types = entryAddr + 4 + offsets[1];
+            meth.imp = offsets[2] ? entryAddr + 8 + offsets[2] : 0;
+
+            // Unless flagged direct, relative names point at a selector reference rather than the string.
+            if (!direct)
+                meth.name = m_vm->ReadULong(meth.name);
         } else {
-            meth.name = reader->ReadULong();
-            meth.types = reader->ReadULong();
-            meth.imp = reader->ReadULong();
+            memcpy(&meth, entry, sizeof(meth));
         }
+        methods.push_back(meth);
+    }
+    return methods;
+}
+
 
-        meth.name = meth.name & 0x1ffffffff;
-        meth.types = meth.types & 0x1ffffffff;
-        meth.imp = meth.imp & 0x1ffffffff;
+void ObjCProcessing::DiscoverMethods(uint64_t listAddr, InternedString className, InternedString category,
+                                     bool classMethods, const std::string &listName, DSCObjC::Discovery &out) {
+    if (!listAddr)
+        return;
 
-        if (!direct) {
-            auto roff = reader->Offset();
-            meth.name = reader->ReadULong(meth.name) & 0x1ffffffff;
-            reader->Seek(roff);
+    auto& strings = m_session->Strings();
+    try {
+        auto methods = LoadMethodList(listAddr);
+        out.data.push_back({listAddr, DSCObjC::MethodListData, listName});
+        for (const auto& m : methods) {
+            // Protocol requirements have nothing to label.
+            if (!m.imp)
+                continue;
+            out.methods.push_back({className, strings.AtAddress(*m_vm, m.name), strings.AtAddress(*m_vm, m.types),
+                                   m.imp, classMethods, category});
         }
-        methods.push_back(meth);
+    } catch (MappingReadException& ex) {
+        // Method list isn't mapped; the class just goes without these methods.
     }
-    return methods;
 }
 
 
-void ObjCProcessing::ApplyMethodType(std::string className, std::string sel, std::string types, uint64_t imp) {
-    std::stringstream r(sel);
+void ObjCProcessing::DiscoverIvars(uint64_t listAddr, InternedString className, const std::string &listName,
+                                   DSCObjC::Discovery &out) {
+    if (!listAddr)
+        return;
 
-    std::string token;
-    std::vector<std::string> result;
-    while (std::getline(r, token, ':'))
-        result.push_back(token);
+    auto& strings = m_session->Strings();
+    try {
+        auto header = ReadStruct<DSCObjC::ListHeader>(listAddr);
+        size_t entsize;
+        auto entries = ReadListEntries(*m_vm, listAddr, header, sizeof(DSCObjC::Ivar), entsize);
+        out.data.push_back({listAddr, DSCObjC::IvarListData, listName});
+
+        std::string prefix = "_OBJC_IVAR_$_" + className.str() + ".";
+        for (size_t i = 0; i < header.count; i++) {
+            DSCObjC::Ivar ivar;
+            memcpy(&ivar, entries.data() + i * entsize, sizeof(ivar));
+            // Anonymous bitfields have no name, and no offset variable of their own.
+            if (!ivar.offset || !ivar.name)
+                continue;
+            auto ivarName = strings.AtAddress(*m_vm, ivar.name);
+            out.data.push_back({ivar.offset, DSCObjC::IvarOffsetData, prefix + ivarName.str()});
+        }
+    } catch (MappingReadException& ex) {
+    }
+}
+
+
+void ObjCProcessing::DiscoverProperties(uint64_t listAddr, const std::string &listName, DSCObjC::Discovery &out) {
+    if (!listAddr)
+        return;
+
+    try {
+        // Properties don't have anything of their own to label; just make sure this really is a list.
+        auto header = ReadStruct<DSCObjC::ListHeader>(listAddr);
+        size_t entsize;
+        ReadListEntries(*m_vm, listAddr, header, sizeof(DSCObjC::Property), entsize);
+        out.data.push_back({listAddr, DSCObjC::PropertyListData, listName});
+    } catch (MappingReadException& ex) {
+    }
+}
 
-    auto selectorTokens = result;
 
-    auto typeTokens = ObjCTypeParser::parseEncodedType(types);
+void ObjCProcessing::DiscoverClass(uint64_t addr, DSCObjC::Discovery &out) {
+    auto& strings = m_session->Strings();
+
+    auto cls = ReadStruct<DSCObjC::Class>(addr);
+    uint64_t roAddr = ClassROAddress(cls, addr);
+    auto ro = ReadStruct<DSCObjC::ClassRO>(roAddr);
+    auto className = strings.AtAddress(*m_vm, ro.name);
+    std::string name = className.str();
+
+    out.data.push_back({addr, DSCObjC::ClassData, "_OBJC_CLASS_$_" + name});
+    out.data.push_back({roAddr, DSCObjC::ClassROData, "__OBJC_CLASS_RO_$_" + name});
+    DiscoverMethods(ro.methods, className, {}, false, "__OBJC_$_INSTANCE_METHODS_" + name, out);
+    DiscoverIvars(ro.ivars, className, "__OBJC_$_INSTANCE_VARIABLES_" + name, out);
+    DiscoverProperties(ro.properties, "__OBJC_$_PROP_LIST_" + name, out);
+
+    // Class methods live on the metaclass.
+    if (!cls.isa || !m_vm->AddressIsMapped(cls.isa))
+        return;
+    auto meta = ReadStruct<DSCObjC::Class>(cls.isa);
+    uint64_t metaROAddr = ClassROAddress(meta, cls.isa);
+    auto metaRO = ReadStruct<DSCObjC::ClassRO>(metaROAddr);
+
+    out.data.push_back({cls.isa, DSCObjC::ClassData, "_OBJC_METACLASS_$_" + name});
+    out.data.push_back({metaROAddr, DSCObjC::ClassROData, "__OBJC_METACLASS_RO_$_" + name});
+    DiscoverMethods(metaRO.methods, className, {}, true, "__OBJC_$_CLASS_METHODS_" + name, out);
+}
+
+
+void ObjCProcessing::DiscoverCategory(uint64_t addr, DSCObjC::Discovery &out) {
+    auto& strings = m_session->Strings();
+
+    auto cat = ReadStruct<DSCObjC::Category>(addr);
+    auto catName = strings.AtAddress(*m_vm, cat.name);
+
+    // The class usually lives in another image; all we need from it is the name.
+    InternedString className = strings.Intern("?");
+    if (cat.cls) {
+        try {
+            auto cls = ReadStruct<DSCObjC::Class>(cat.cls);
+            auto ro = ReadStruct<DSCObjC::ClassRO>(ClassROAddress(cls, cat.cls));
+            className = strings.AtAddress(*m_vm, ro.name);
+        } catch (MappingReadException& ex) {
+        }
+    }
+
+    std::string suffix = className.str() + "_$_" + catName.str();
+    out.data.push_back({addr, DSCObjC::CategoryData, "__OBJC_$_CATEGORY_" + suffix});
+    DiscoverMethods(cat.instanceMethods, className, catName, false, "__OBJC_$_CATEGORY_INSTANCE_METHODS_" + suffix, out);
+    DiscoverMethods(cat.classMethods, className, catName, true, "__OBJC_$_CATEGORY_CLASS_METHODS_" + suffix, out);
+    DiscoverProperties(cat.instanceProperties, "__OBJC_$_PROP_LIST_" + suffix, out);
+}
+
+
+void ObjCProcessing::DiscoverProtocol(uint64_t addr, DSCObjC::Discovery &out) {
+    auto& strings = m_session->Strings();
+
+    auto proto = ReadStruct<DSCObjC::Protocol>(addr);
+    auto protoName = strings.AtAddress(*m_vm, proto.name);
+    std::string name = protoName.str();
+
+    out.data.push_back({addr, DSCObjC::ProtocolData, "_OBJC_PROTOCOL_$_" + name});
+    // Only the lists get labelled; their methods have no implementations.
+    DiscoverMethods(proto.instanceMethods, protoName, {}, false, "__OBJC_$_PROTOCOL_INSTANCE_METHODS_" + name, out);
+    DiscoverMethods(proto.classMethods, protoName, {}, true, "__OBJC_$_PROTOCOL_CLASS_METHODS_" + name, out);
+    DiscoverMethods(proto.optionalInstanceMethods, protoName, {}, false,
+                    "__OBJC_$_PROTOCOL_INSTANCE_METHODS_OPT_" + name, out);
+    DiscoverMethods(proto.optionalClassMethods, protoName, {}, true, "__OBJC_$_PROTOCOL_CLASS_METHODS_OPT_" + name, out);
+    DiscoverProperties(proto.instanceProperties, "__OBJC_$_PROP_LIST_" + name, out);
+}
+
+
+Ref<Type> ObjCProcessing::TypeForToken(const std::string& token) {
+    if (auto it = m_tokenTypes.find(token); it != m_tokenTypes.end())
+        return it->second;
+
+    // Tokens are one of the TypeEncodingMap spellings followed by zero or more '*'.
+    size_t baseEnd = token.size();
+    size_t pointerDepth = 0;
+    while (baseEnd > 0 && (token[baseEnd - 1] == '*' || token[baseEnd - 1] == ' ')) {
+        if (token[baseEnd - 1] == '*')
+            pointerDepth++;
+        baseEnd--;
+    }
+    std::string base = token.substr(0, baseEnd);
+
+    size_t addrSize = m_dscView->GetAddressSize();
+    Ref<Type> type;
+    if (base == "void")
+        type = Type::VoidType();
+    else if (base == "char")
+        type = Type::IntegerType(1, true);
+    else if (base == "short")
+        type = Type::IntegerType(2, true);
+    else if (base == "int")
+        type = Type::IntegerType(4, true);
+    else if (base == "long")
+        type = Type::IntegerType(addrSize, true);
+    else if (base == "unsigned char" || base == "uint8_t")
+        type = Type::IntegerType(1, false);
+    else if (base == "unsigned short")
+        type = Type::IntegerType(2, false);
+    else if (base == "unsigned int")
+        type = Type::IntegerType(4, false);
+    else if (base == "unsigned long")
+        type = Type::IntegerType(addrSize, false);
+    else if (base == "float")
+        type = Type::FloatType(4);
+    else if (base == "BOOL" || base == "NSInteger" || base == "NSUInteger" || base == "CGFloat"
+             || base == CustomTypes::ID || base == CustomTypes::Selector || base == CustomTypes::Class)
+        type = Type::NamedType(m_dscView, QualifiedName(base));
+
+    if (type)
+        for (size_t i = 0; i < pointerDepth; i++)
+            type = Type::PointerType(addrSize, type);
+
+    m_tokenTypes[token] = type;
+    return type;
+}
+
+
+const std::vector<Ref<Type>>& ObjCProcessing::TypesForEncoding(const InternedString& encodedType) {
+    if (auto it = m_encodingTypes.find(encodedType.id); it != m_encodingTypes.end())
+        return it->second;
+
+    std::vector<Ref<Type>> types;
+    for (const auto& token : ObjCTypeParser::parseEncodedType(encodedType.str())) {
+        auto type = TypeForToken(token);
+        if (!type) {
+            types.clear();
+            break;
+        }
+        types.push_back(type);
+    }
+
+    return m_encodingTypes.emplace(encodedType.id, std::move(types)).first->second;
+}
+
+
+void ObjCProcessing::ApplyMethodType(const DSCObjC::MethodRecord &method) {
+    std::string_view sel = method.selector.value;
+
+    // Split on ':' (a trailing one doesn't start another token).
+    std::vector<std::string_view> selectorTokens;
+    for (size_t start = 0; start < sel.size();) {
+        size_t end = std::min(sel.find(':', start), sel.size());
+        selectorTokens.push_back(sel.substr(start, end - start));
+        start = end + 1;
+    }
+
+    // Identical encodings are everywhere (v16@0:8 alone covers a good chunk of any image), so the token -> Type
+    //  work is done once per encoding.
+    const auto& typeTokens = TypesForEncoding(method.types);
 
     // For safety, ensure out-of-bounds indexing is not about to occur. This has
     // never happened and likely won't ever happen, but crashing the product is
     // generally undesirable, so it's better to be safe than sorry.
-    if (selectorTokens.size() > typeTokens.size()) {
-        BNLogError("oh no");
+    if (!typeTokens.empty() && selectorTokens.size() > typeTokens.size()) {
+        BNLogError("Skipping type of %c[%.*s %.*s]: its encoding %.*s has fewer arguments than the selector",
+                   method.classMethod ? '+' : '-', (int)method.className.value.size(), method.className.value.data(),
+                   (int)sel.size(), sel.data(), (int)method.types.value.size(), method.types.value.data());
         return;
     }
 
-    // Shorthand for formatting an individual "part" of the type signature.
-    auto partForIndex = [selectorTokens, typeTokens](size_t i) {
-        std::string argName;
+    Ref<Type> functionType;
+    if (!typeTokens.empty()) {
+        if (!m_callingConvention)
+            m_callingConvention = m_dscView->GetDefaultPlatform()->GetDefaultCallingConvention();
 
         // Indices 0, 1, and 2 are the function return type, self parameter, and
         // selector parameter, respectively. Indices 3+ are the actual
         // arguments to the function.
-        if (i == 0)
-            argName = "";
-        else if (i == 1)
-            argName = "self";
-        else if (i == 2)
-            argName = "sel";
-        else if (i - 3 < selectorTokens.size())
-            argName = selectorTokens[i - 3];
-
-        return typeTokens[i] + " " + argName;
-    };
-
-    // Build the type string for the method.
-    std::string typeString;
-    for (size_t i = 0; i < typeTokens.size(); ++i) {
-        std::string suffix;
-        auto part = partForIndex(i);
-
-        // The underscore being used as the function name here is critically
-        // important as Clang will not parse the type string correctly---unlike
-        // the old type parser---if there is no function name. The underscore
-        // itself isn't special, and will not end up being used as the function
-        // name in either case.
-        if (i == 0)
-            suffix = " _(";
-        else if (i == typeTokens.size() - 1)
-            suffix = ")";
-        else
-            suffix = ", ";
-
-        typeString += part + suffix;
+        std::vector<FunctionParameter> params;
+        params.reserve(typeTokens.size() - 1);
+        for (size_t i = 1; i < typeTokens.size(); ++i) {
+            std::string argName;
+            if (i == 1)
+                argName = "self";
+            else if (i == 2)
+                argName = "sel";
+            else if (i - 3 < selectorTokens.size())
+                argName = std::string(selectorTokens[i - 3]);
+            params.emplace_back(argName, typeTokens[i]);
+        }
+        functionType = Type::FunctionType(typeTokens[0], m_callingConvention, params);
     }
-    typeString += ";";
 
-    std::string errors;
-    TypeParserResult tpResult;
-    auto ok = m_dscView->ParseTypesFromSource(typeString, {}, {}, tpResult, errors);
-    if (ok && !tpResult.functions.empty()) {
-        auto functionType = tpResult.functions[0].type;
+    std::string name;
+    name.reserve(method.className.value.size() + method.category.value.size() + sel.size() + 6);
+    name.append(method.classMethod ? "+[" : "-[").append(method.className.value);
+    if (method.category.id != UINT32_MAX)
+        name.append("(").append(method.category.value).append(")");
+    name.append(" ").append(sel).append("]");
+    m_pendingMethods.push_back({method.imp, std::move(name), functionType});
+}
 
+
+/*
+ * Creates the functions, symbols, types and data variables queued during LoadObjCMetadata.
+ *
+ * Symbol definitions go through a single bulk modification, so the view only has to process them once per image.
+ */
+void ObjCProcessing::ApplyPending() {
+    if (m_pendingMethods.empty() && m_pendingData.empty())
+        return;
+
+    auto platform = m_dscView->GetDefaultPlatform();
+
+    Ref<Type> dataTypes[] = {
+        Type::NamedType(m_dscView, m_types.Class),        // ClassData
+        Type::NamedType(m_dscView, m_types.ClassRO),      // ClassROData
+        Type::NamedType(m_dscView, m_types.MethodList),   // MethodListData
+        Type::NamedType(m_dscView, m_types.IvarList),     // IvarListData
+        Type::IntegerType(4, true),                       // IvarOffsetData
+        Type::NamedType(m_dscView, m_types.PropertyList), // PropertyListData
+        Type::NamedType(m_dscView, m_types.Category),     // CategoryData
+        Type::NamedType(m_dscView, m_types.Protocol),     // ProtocolData
+    };
+
+    m_dscView->BeginBulkModifySymbols();
+    for (const auto& data : m_pendingData) {
+        m_dscView->DefineDataVariable(data.address, dataTypes[data.kind]);
+        m_dscView->DefineUserSymbol(new Symbol(DataSymbol, data.name, data.address));
+    }
+    for (const auto& method : m_pendingMethods) {
         // k: we are not in workflow phase so we need to define this here ourself.
-        m_dscView->AddFunctionForAnalysis(m_dscView->GetDefaultPlatform(), imp);
+        if (method.type)
+            m_dscView->AddFunctionForAnalysis(platform, method.imp);
+        m_dscView->DefineUserSymbol(new Symbol(FunctionSymbol, method.name, method.imp));
+    }
+    m_dscView->EndBulkModifySymbols();
 
+    for (const auto& method : m_pendingMethods) {
+        if (!method.type)
+            continue;
         // Search for the method's implementation function; apply the type if found.
-        if (auto f = m_dscView->GetAnalysisFunction(m_dscView->GetDefaultPlatform(), imp))
-            f->SetUserType(functionType);
+        if (auto f = m_dscView->GetAnalysisFunction(platform, method.imp))
+            f->SetUserType(method.type);
     }
 
-    // TODO: Use '+' or '-' conditionally once class methods are supported. For
-    // right now, only instance methods are analyzed and we can just use '-'.
-    auto name = "-[" + className + " " + sel + "]";
-    m_dscView->DefineUserSymbol(new Symbol(FunctionSymbol, name, imp));
+    m_pendingMethods.clear();
+    m_pendingData.clear();
 }
 
 
 void ObjCProcessing::LoadObjCMetadata(KMachOHeader &image) {
     if (!m_typesLoaded)
         LoadTypes();
-    std::vector<DSCObjC::Class *> classes;
-    //try {
-        classes = GetClassList(image);
-    //}
-    //catch (...)
-    //{
-    //    BNLogError("Error reading Obj-C Metadata");
-    //    return;
-    //}
-
-    for (auto c: classes) {
-        //// BNLogInfo("%s", m_cache->m_vm->ReadNullTermString(c->ro_data->name).c_str());
-        try {
 
-            auto meths = LoadMethodList(c->ro_data->methods);
+    struct SectionHandler {
+        const char* section;
+        const char* description;
+        void (ObjCProcessing::*discover)(uint64_t, DSCObjC::Discovery &);
+    };
+    static const SectionHandler handlers[] = {
+        {"__objc_classlist", "Class", &ObjCProcessing::DiscoverClass},
+        {"__objc_catlist", "Category", &ObjCProcessing::DiscoverCategory},
+        {"__objc_protolist", "Protocol", &ObjCProcessing::DiscoverProtocol},
+    };
+
+    std::vector<std::pair<const SectionHandler*, uint64_t>> entries;
+    for (const auto& handler : handlers)
+        for (auto ptr : GetPointerList(image, handler.section))
+            entries.push_back({&handler, ptr});
+    if (entries.empty())
+        return;
 
-            for (auto m: meths) {
-                //// BNLogInfo(":: %s", m_cache->m_vm->ReadNullTermString(m.name).c_str());
-                ApplyMethodType(m_vm->ReadNullTermString(c->ro_data->name),
-                                m_vm->ReadNullTermString(m.name), m_vm->ReadNullTermString(m.types),
-                                m.imp);
+    // Entries are handed out in small batches to keep the per-batch results reasonably sized.
+    constexpr size_t batchSize = 32;
+    size_t batchCount = (entries.size() + batchSize - 1) / batchSize;
+    std::vector<DSCObjC::Discovery> batches(batchCount);
+
+    ParallelFor(batchCount, [&](size_t batch) {
+        size_t end = std::min(entries.size(), (batch + 1) * batchSize);
+        for (size_t i = batch * batchSize; i < end; i++) {
+            auto [handler, ptr] = entries[i];
+            try {
+                (this->*handler->discover)(ptr, batches[batch]);
+            }
+            catch (MappingReadException& ex)
+            {
+                BNLogError("Failed to load Obj-C %s at 0x%llx", handler->description, ptr);
             }
-        } catch (...) {
-            // BNLogError("failz xD");
         }
+    });
+
+    // Discovery only reads the VM and fans out; everything touching the view happens here, on this thread.
+    for (auto& discovery : batches) {
+        for (const auto& m : discovery.methods)
+            ApplyMethodType(m);
+        std::move(discovery.data.begin(), discovery.data.end(), std::back_inserter(m_pendingData));
     }
+
+    ApplyPending();
 }
 
 void ObjCProcessing::LoadTypes() {
@@ -479,12 +727,49 @@ void ObjCProcessing::LoadTypes() {
     ivarBuilder.AddMember(Type::IntegerType(4, false), "alignment");
     ivarBuilder.AddMember(Type::IntegerType(4, false), "size");
     type = FinalizeStructureBuilder(m_dscView, ivarBuilder, "objc_ivar_t");
-    // m_types. = type.first;
+    m_types.Ivar = type.first;
 
     StructureBuilder ivarList;
     ivarList.AddMember(Type::IntegerType(4, false), "entsize");
     ivarList.AddMember(Type::IntegerType(4, false), "count");
     type = FinalizeStructureBuilder(m_dscView, ivarList, "objc_ivar_list_t");
+    m_types.IvarList = type.first;
+
+    StructureBuilder propertyBuilder;
+    propertyBuilder.AddMember(Type::PointerType(addrSize, Type::VoidType()), "name");
+    propertyBuilder.AddMember(Type::PointerType(addrSize, Type::VoidType()), "attributes");
+    type = FinalizeStructureBuilder(m_dscView, propertyBuilder, "objc_property_t");
+    m_types.Property = type.first;
+
+    StructureBuilder propertyList;
+    propertyList.AddMember(Type::IntegerType(4, false), "entsize");
+    propertyList.AddMember(Type::IntegerType(4, false), "count");
+    type = FinalizeStructureBuilder(m_dscView, propertyList, "objc_property_list_t");
+    m_types.PropertyList = type.first;
+
+    StructureBuilder categoryBuilder;
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "name");
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "cls");
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "instance_methods");
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "class_methods");
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "protocols");
+    categoryBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "instance_properties");
+    type = FinalizeStructureBuilder(m_dscView, categoryBuilder, "objc_category_t");
+    m_types.Category = type.first;
+
+    StructureBuilder protocolBuilder;
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "isa");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "name");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "protocols");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "instance_methods");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "class_methods");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "optional_instance_methods");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "optional_class_methods");
+    protocolBuilder.AddMember(Type::NamedType(m_dscView, CustomTypes::TaggedPointer), "instance_properties");
+    protocolBuilder.AddMember(Type::IntegerType(4, false), "size");
+    protocolBuilder.AddMember(Type::IntegerType(4, false), "flags");
+    type = FinalizeStructureBuilder(m_dscView, protocolBuilder, "objc_protocol_t");
+    m_types.Protocol = type.first;
 
     m_typesLoaded = true;
 }
\ No newline at end of file
@@ -5,9 +5,11 @@
 #ifndef KSUITE_OBJC_H
 #define KSUITE_OBJC_H
 
+#include <unordered_map>
 #include <binaryninjaapi.h>
-#include "VM.h"
+#include "Core/VM.h"
 #include "SharedCache.h"
+#include "Core/StringTable.h"
 
 using namespace BinaryNinja;
 
@@ -26,6 +28,12 @@ namespace CustomTypes {
     const std::string MethodListEntry = "objc_method_entry_t";
     const std::string Class = "objc_class_t";
     const std::string ClassRO = "objc_class_ro_t";
+    const std::string Ivar = "objc_ivar_t";
+    const std::string IvarList = "objc_ivar_list_t";
+    const std::string Property = "objc_property_t";
+    const std::string PropertyList = "objc_property_list_t";
+    const std::string Category = "objc_category_t";
+    const std::string Protocol = "objc_protocol_t";
 }
 
 struct ObjCTypes {
@@ -43,11 +51,19 @@ struct ObjCTypes {
     BinaryNinja::QualifiedName MethodListEntry;
     BinaryNinja::QualifiedName Class;
     BinaryNinja::QualifiedName ClassRO;
+    BinaryNinja::QualifiedName Ivar;
+    BinaryNinja::QualifiedName IvarList;
+    BinaryNinja::QualifiedName Property;
+    BinaryNinja::QualifiedName PropertyList;
+    BinaryNinja::QualifiedName Category;
+    BinaryNinja::QualifiedName Protocol;
 };
 
 
 namespace DSCObjC {
 
+    // These mirror the in-memory layouts, so each one is fetched with a single read.
+
     struct ClassRO {
         uint32_t flags;     //0
         uint32_t start;     //4
@@ -67,7 +83,46 @@ namespace DSCObjC {
         uint64_t super;
         uint64_t cache;
         uint64_t vtable;
-        ClassRO *ro_data;
+        uint64_t data;
+    };
+
+    struct Category {
+        uint64_t name;
+        uint64_t cls;
+        uint64_t instanceMethods;
+        uint64_t classMethods;
+        uint64_t protocols;
+        uint64_t instanceProperties;
+    };
+
+    struct Protocol {
+        uint64_t isa;
+        uint64_t name;
+        uint64_t protocols;
+        uint64_t instanceMethods;
+        uint64_t classMethods;
+        uint64_t optionalInstanceMethods;
+        uint64_t optionalClassMethods;
+        uint64_t instanceProperties;
+    };
+
+    // Header shared by method, ivar and property lists.
+    struct ListHeader {
+        uint32_t entsizeAndFlags;
+        uint32_t count;
+    };
+
+    struct Ivar {
+        uint64_t offset;
+        uint64_t name;
+        uint64_t type;
+        uint32_t alignment;
+        uint32_t size;
+    };
+
+    struct Property {
+        uint64_t name;
+        uint64_t attributes;
     };
 
     struct Method {
@@ -75,6 +130,39 @@ namespace DSCObjC {
         uint64_t types;
         uint64_t imp;
     };
+
+    // One method found during discovery, ready to be applied to the view.
+    struct MethodRecord {
+        InternedString className;
+        InternedString selector;
+        InternedString types;
+        uint64_t imp;
+        bool classMethod;
+        InternedString category; // id is UINT32_MAX outside of categories
+    };
+
+    enum DataKind : uint8_t {
+        ClassData,
+        ClassROData,
+        MethodListData,
+        IvarListData,
+        IvarOffsetData,
+        PropertyListData,
+        CategoryData,
+        ProtocolData,
+    };
+
+    // A metadata structure found during discovery, to be typed and named in the view.
+    struct DataRecord {
+        uint64_t address;
+        DataKind kind;
+        std::string name;
+    };
+
+    struct Discovery {
+        std::vector<MethodRecord> methods;
+        std::vector<DataRecord> data;
+    };
 }
 
 
@@ -97,6 +185,7 @@ class ObjCProcessing {
     std::shared_ptr<VM> m_vm;
     Ref<BinaryView> m_dscView;
     SharedCache* m_cache;
+    std::shared_ptr<CacheSession> m_session;
     ObjCTypes m_types{};
     Ref<Logger> m_logger;
 
@@ -105,13 +194,57 @@ class ObjCProcessing {
 
     std::optional<uint64_t> m_customRelativeMethodSelectorBase;
 
+    /* METHOD TYPES START */
+    struct PendingMethod {
+        uint64_t imp;
+        std::string name;
+        Ref<Type> type; // nullptr if the encoding couldn't be turned into a type
+    };
+
+    Ref<CallingConvention> m_callingConvention;
+    std::unordered_map<std::string, Ref<Type>> m_tokenTypes;
+    // Interned encoding ID -> {return, self, _cmd, args...}; empty if the encoding has a token we can't type.
+    std::unordered_map<uint32_t, std::vector<Ref<Type>>> m_encodingTypes;
+    std::vector<PendingMethod> m_pendingMethods;
+    std::vector<DSCObjC::DataRecord> m_pendingData;
+    /* METHOD TYPES END */
+
     void LoadTypes();
 
-    std::vector<DSCObjC::Class *> GetClassList(KMachOHeader &image);
+    Ref<Type> TypeForToken(const std::string& token);
+    const std::vector<Ref<Type>>& TypesForEncoding(const InternedString& encodedType);
+    void ApplyPending();
+
+    std::vector<uint64_t> GetPointerList(KMachOHeader &image, const std::string &sectionName);
+
+    template <typename T>
+    T ReadStruct(uint64_t addr) {
+        T result;
+        m_vm->Read(&result, addr, sizeof(T));
+        return result;
+    }
+
+    uint64_t ClassROAddress(const DSCObjC::Class &cls, uint64_t addr);
 
     std::vector<DSCObjC::Method> LoadMethodList(uint64_t addr);
 
-    void ApplyMethodType(std::string className, std::string sel, std::string types, uint64_t imp);
+    /*
+     * Discovery: one entry per pointer in __objc_classlist, __objc_catlist and __objc_protolist.
+     *
+     * These only read the VM, never the view, so they run spread across all cores.
+     * A malformed structure is skipped; whatever was already found for the entry is kept.
+     */
+    void DiscoverClass(uint64_t addr, DSCObjC::Discovery &out);
+    void DiscoverCategory(uint64_t addr, DSCObjC::Discovery &out);
+    void DiscoverProtocol(uint64_t addr, DSCObjC::Discovery &out);
+
+    void DiscoverMethods(uint64_t listAddr, InternedString className, InternedString category, bool classMethods,
+                         const std::string &listName, DSCObjC::Discovery &out);
+    void DiscoverIvars(uint64_t listAddr, InternedString className, const std::string &listName,
+                       DSCObjC::Discovery &out);
+    void DiscoverProperties(uint64_t listAddr, const std::string &listName, DSCObjC::Discovery &out);
+
+    void ApplyMethodType(const DSCObjC::MethodRecord &method);
 
 public:
     ObjCProcessing(Ref<BinaryView> view, SharedCache *cache, std::shared_ptr<VM> vm);
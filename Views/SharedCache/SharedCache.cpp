@@ -5,692 +5,561 @@
 #include "SharedCache.h"
 #include <binaryninjaapi.h>
 #include <ksuiteapi.h>
+#include <ksuitecore.h>
 #include "highlevelilinstruction.h"
 #include "ObjC.h"
+#include "Core/ExportTrie.h"
+#include "Core/IndexCache.h"
+#include "Core/Log.h"
 #include <filesystem>
 #include <utility>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <memory>
+#include <unordered_set>
+#include <algorithm>
 
 using namespace BinaryNinja;
 
 
-static int64_t readSLEB128(DataBuffer& buffer, size_t length, size_t &offset)
+bool SharedCache::SetupVMMap()
 {
-    uint8_t cur;
-    int64_t value = 0;
-    size_t shift = 0;
-    while (offset < length)
-    {
-        cur = buffer[offset++];
-        value |= (cur & 0x7f) << shift;
-        shift += 7;
-        if ((cur & 0x80) == 0)
-            break;
-    }
-    value = (value << (64 - shift)) >> (64 - shift);
-    return value;
-}
+    // Nested sessions (e.g. ObjCProcessing asking for an image start mid-load) just reuse the outer one.
+    if (m_sessionDepth++ > 0)
+        return m_baseFile != nullptr;
 
+    if (!m_session)
+        m_session = CacheSession::Acquire(m_dscView->GetFile()->GetOriginalFilename());
+    if (!m_session)
+        return false;
 
-static uint64_t readLEB128(DataBuffer& p, size_t end, size_t &offset)
+    m_baseFile = m_session->BaseFile();
+    m_vm = m_session->GetVM();
+    return true;
+}
+bool SharedCache::TeardownVMMap()
 {
-    uint64_t result = 0;
-    int bit = 0;
-    do {
-        if (offset >= end)
-            return -1;
-
-        uint64_t slice = p[offset] & 0x7f;
-
-        if (bit > 63)
-            return -1;
-        else {
-            result |= (slice << bit);
-            bit += 7;
-        }
-    } while (p[offset++] & 0x80);
-    return result;
+    if (m_sessionDepth == 0 || --m_sessionDepth > 0)
+        return true;
+    m_baseFile.reset();
+    m_vm.reset();
+    return true;
 }
 
-
-uint64_t readValidULEB128(DataBuffer& buffer, size_t& cursor)
+SharedCacheFormat SharedCache::GetCacheFormat()
 {
-    uint64_t value = readLEB128(buffer, buffer.GetLength(), cursor);
-    if ((int64_t)value == -1)
-        throw ReadException();
-    return value;
+    if (!m_session)
+        m_session = CacheSession::Acquire(m_dscView->GetFile()->GetOriginalFilename());
+    if (!m_session)
+        return RegularCacheFormat;
+    return m_session->Format();
 }
 
-bool SharedCache::SetupVMMap(bool mapPages)
+bool SharedCache::LoadBinaryState(Ref<BinaryView> view)
 {
-    auto path = m_dscView->GetFile()->GetOriginalFilename();
-    try {
-        m_baseFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(path));
-    }
-    catch (MissingFileException& exc)
-    {
+    auto state = view->GetRawMetadata(SharedCacheStateTag);
+    SharedCacheStateRecord record{};
+    if (state.size() < sizeof(record))
         return false;
-    }
-
-    DataBuffer sig = *m_baseFile->ReadBuffer(0, 4);
-    if (sig.GetLength() != 4)
-        return false;
-    const char *magic = (char *) sig.GetData();
-    if (strncmp(magic, "dyld", 4) != 0)
+    memcpy(&record, state.data(), sizeof(record));
+    if (memcmp(record.magic, "KDSC", 4) != 0 || record.version != SharedCacheStateVersion)
         return false;
-    if (mapPages)
-    {
-        auto format = GetCacheFormat();
-
-        dyld_cache_header header{};
-        size_t header_size = m_baseFile->ReadUInt32(16);
-        m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
-
-        switch (format) {
-            case RegularCacheFormat: {
-                m_vm = std::shared_ptr<VM>(new VM(0x4000)); // TODO: way to absolutely determine page size
-
-                dyld_cache_mapping_info mapping{};
 
-                for (size_t i = 0; i < header.mappingCount; i++) {
-                    m_baseFile->Read(&mapping, header.mappingOffset + (i * sizeof(mapping)),
-                               sizeof(mapping));
-                    m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, m_baseFile);
-                }
-                m_pagesMapped = true;
-            }
-            case LargeCacheFormat: {
-                m_vm = std::shared_ptr<VM>(new VM(0x4000));
-
-                // First, map our main cache.
-
-                dyld_cache_mapping_info mapping{}; // We're going to reuse this for all of the mappings. We only need it briefly.
-
-                for (size_t i = 0; i < header.mappingCount; i++) {
-                    m_baseFile->Read(&mapping, header.mappingOffset + (i * sizeof(mapping)),
-                               sizeof(mapping));
-                    m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, m_baseFile);
-                }
-
-                auto mainFileName = m_baseFile->Path();
-                auto subCacheCount = header.subCacheArrayCount;
-                dyld_subcache_entry2 entry{};
-
-                for (size_t i = 0; i < subCacheCount; i++) {
-
-                    m_baseFile->Read(&entry, header.subCacheArrayOffset + (i * sizeof(dyld_subcache_entry2)),
-                               sizeof(dyld_subcache_entry2));
-
-                    std::string subCachePath;
-                    if (std::string(entry.fileExtension).find('.') != std::string::npos)
-                        subCachePath = mainFileName + entry.fileExtension;
-                    else
-                        subCachePath = mainFileName + "." + entry.fileExtension;
-                    auto subCacheFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCachePath));
-
-                    auto header_size = subCacheFile->ReadUInt32(16);
-                    dyld_cache_header header{};
-                    subCacheFile->Read(&header, 0, header_size);
-
-                    dyld_cache_mapping_info subCacheMapping{};
-
-                    for (size_t j = 0; j < header.mappingCount; j++) {
-
-                        subCacheFile->Read(&subCacheMapping, header.mappingOffset + (j * sizeof(subCacheMapping)),
-                                           sizeof(subCacheMapping));
-                        m_vm->MapPages(subCacheMapping.address, subCacheMapping.fileOffset, subCacheMapping.size,
-                                              subCacheFile);
-                    }
-                }
-                m_pagesMapped = true;
-            }
-            case SplitCacheFormat: {
-                m_vm = std::shared_ptr<VM>(new VM(0x4000));
-
-                // First, map our main cache.
-
-                dyld_cache_mapping_info mapping{}; // We're going to reuse this for all of the mappings. We only need it briefly.
-
-                for (size_t i = 0; i < header.mappingCount; i++) {
-                    m_baseFile->Read(&mapping, header.mappingOffset + (i * sizeof(mapping)),
-                               sizeof(mapping));
-                    m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, m_baseFile);
-                }
-
-                auto mainFileName = m_baseFile->Path();
-                auto subCacheCount = header.subCacheArrayCount;
-
-                for (size_t i = 1; i <= subCacheCount; i++) {
-                    auto subCachePath = mainFileName + "." + std::to_string(i);
-                    auto subCacheFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCachePath));
-                    auto header_size = subCacheFile->ReadUInt32(16);
-                    dyld_cache_header header{};
-                    subCacheFile->Read(&header, 0, header_size);
-
-                    dyld_cache_mapping_info subCacheMapping{};
-
-                    for (size_t j = 0; j < header.mappingCount; j++) {
-                        subCacheFile->Read(&subCacheMapping, header.mappingOffset + (j * sizeof(subCacheMapping)),
-                                           sizeof(subCacheMapping));
-                        m_vm->MapPages(subCacheMapping.address, subCacheMapping.fileOffset, subCacheMapping.size,
-                                              subCacheFile);
-                    }
-                }
-
-                // Load .symbols subcache
-
-                auto subCachePath = mainFileName + ".symbols";
-                auto subCacheFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCachePath));
-
-                auto subcache_header_size = subCacheFile->ReadUInt32(16);
-                dyld_cache_header subcacheHeader{};
-                subCacheFile->Read(&subcacheHeader, 0, subcache_header_size);
-
-                dyld_cache_mapping_info subCacheMapping{};
-
-                for (size_t j = 0; j < subcacheHeader.mappingCount; j++) {
-                    subCacheFile->Read(&subCacheMapping, subcacheHeader.mappingOffset + (j * sizeof(subCacheMapping)),
-                                       sizeof(subCacheMapping));
-                    m_vm->MapPages(subCacheMapping.address, subCacheMapping.fileOffset, subCacheMapping.size,
-                                          subCacheFile);
-                }
-                m_pagesMapped = true;
-            }
-            case iOS16CacheFormat: {
-                m_vm = std::shared_ptr<VM>(new VM(0x4000));
-
-                // First, map our main cache.
-
-                dyld_cache_mapping_info mapping{};
-
-                for (size_t i = 0; i < header.mappingCount; i++) {
-                    m_baseFile->Read(&mapping, header.mappingOffset + (i * sizeof(mapping)),
-                               sizeof(mapping));
-                    m_vm->MapPages(mapping.address, mapping.fileOffset, mapping.size, m_baseFile);
-                }
-
-                auto mainFileName = m_baseFile->Path();
-                auto subCacheCount = header.subCacheArrayCount;
-
-                dyld_subcache_entry2 entry{};
-
-                for (size_t i = 0; i < subCacheCount; i++) {
-
-                    m_baseFile->Read(&entry, header.subCacheArrayOffset + (i * sizeof(dyld_subcache_entry2)),
-                               sizeof(dyld_subcache_entry2));
-
-                    std::string subCachePath;
-                    if (std::string(entry.fileExtension).find('.') != std::string::npos)
-                        subCachePath = mainFileName + entry.fileExtension;
-                    else
-                        subCachePath = mainFileName + "." + entry.fileExtension;
-
-                    auto subCacheFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCachePath));
-
-                    auto header_size = subCacheFile->ReadUInt32(16);
-                    dyld_cache_header header{};
-                    subCacheFile->Read(&header, 0, header_size);
-
-                    dyld_cache_mapping_info subCacheMapping{};
-
-                    for (size_t j = 0; j < header.mappingCount; j++) {
+    m_viewState = (ViewState)record.viewState;
+    for (uint32_t i = 0; i < record.imageCount; i++)
+    {
+        auto data = view->GetRawMetadata(SharedCacheImageTagPrefix + std::to_string(i));
+        LoadedImage image;
+        if (!LoadedImage::Decode(data.data(), data.size(), image))
+            break;
+        m_loadOrder.push_back(image.name);
+        m_loadedImages[image.name] = std::move(image);
+    }
+    m_persistedImageCount = m_loadOrder.size();
+    return true;
+}
 
-                        subCacheFile->Read(&subCacheMapping, header.mappingOffset + (j * sizeof(subCacheMapping)),
-                                           sizeof(subCacheMapping));
-                        m_vm->MapPages(subCacheMapping.address, subCacheMapping.fileOffset, subCacheMapping.size,
-                                              subCacheFile);
-                    }
-                }
+void SharedCache::DeserializeFromRawView()
+{
+    m_viewState = Loaded;
+    m_loadedImages.clear();
+    m_loadOrder.clear();
+    m_persistedImageCount = 0;
 
-                // Load .symbols subcache
-                try {
-                    auto subCachePath = mainFileName + ".symbols";
-                    auto subCacheFile = std::shared_ptr<MMappedFileAccessor>(new MMappedFileAccessor(subCachePath));
-                    auto header_size = subCacheFile->ReadUInt32(16);
-                    dyld_cache_header header{};
-                    subCacheFile->Read(&header, 0, header_size);
-
-                    dyld_cache_mapping_info subCacheMapping{};
-
-                    for (size_t j = 0; j < header.mappingCount; j++) {
-                        subCacheFile->Read(&subCacheMapping, header.mappingOffset + (j * sizeof(subCacheMapping)),
-                                           sizeof(subCacheMapping));
-                        m_vm->MapPages(subCacheMapping.address, subCacheMapping.fileOffset, subCacheMapping.size,
-                                              subCacheFile);
-                    }
-                } catch (...) {
+    if (m_dscView->QueryMetadata(SharedCacheStateTag) && LoadBinaryState(m_dscView))
+        return;
 
-                }
-                m_pagesMapped = true;
-            }
+    // Older databases: JSON, on the DSCView and (a copy) on the file's root view. The next save converts it.
+    Ref<BinaryView> rootView = m_dscView->GetParentView() ? m_dscView->GetParentView()->GetParentView() : nullptr;
+    for (const Ref<BinaryView>& view : {Ref<BinaryView>(m_dscView), rootView})
+    {
+        if (view && view->QueryMetadata(SharedCacheMetadataTag))
+        {
+            LoadFromString(view->GetStringMetadata(SharedCacheMetadataTag));
+            return;
         }
     }
-    return true;
 }
-bool SharedCache::TeardownVMMap()
+
+bool SharedCache::SaveToDSCView()
 {
-    m_baseFile.reset();
-    if (m_pagesMapped)
-        m_vm.reset();
+    if (!m_dscView)
+        return false;
+
+    for (; m_persistedImageCount < m_loadOrder.size(); m_persistedImageCount++)
+    {
+        auto it = m_loadedImages.find(m_loadOrder[m_persistedImageCount]);
+        if (it == m_loadedImages.end())
+            break;
+        m_dscView->StoreMetadata(SharedCacheImageTagPrefix + std::to_string(m_persistedImageCount),
+                                 new Metadata(it->second.Encode()));
+    }
+
+    SharedCacheStateRecord record{};
+    memcpy(record.magic, "KDSC", 4);
+    record.version = SharedCacheStateVersion;
+    record.viewState = m_viewState;
+    record.imageCount = (uint32_t)m_persistedImageCount;
+    std::vector<uint8_t> state(sizeof(record));
+    memcpy(state.data(), &record, sizeof(record));
+    m_dscView->StoreMetadata(SharedCacheStateTag, new Metadata(state));
     return true;
 }
 
-SharedCache::SharedCacheFormat SharedCache::GetCacheFormat()
+SharedCache::SharedCache(BinaryNinja::BinaryView* dscView)
+    : m_dscView(dscView)
 {
-    // The second argument to this MUST be false.
-    // Mapping the pages invokes this function.
-    if (!m_baseFile)
-        auto mapLock = ScopedVMMapSession(this, false);
+    DeserializeFromRawView();
+    m_loadedImageCount = m_loadedImages.size();
+}
 
-    dyld_cache_header header{};
-    size_t header_size = m_baseFile->ReadUInt32(16);
-    m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
+std::mutex SharedCache::s_viewsMutex;
+std::unordered_map<BNBinaryView*, SharedCache::RegisteredView> SharedCache::s_views;
 
-    if (header.imagesCountOld != 0)
-        return RegularCacheFormat;
+void SharedCache::RegisterView(BinaryNinja::BinaryView* dscView)
+{
+    size_t sessionId = dscView->GetFile()->GetSessionId();
+    std::unique_lock<std::mutex> lock(s_viewsMutex);
+    s_views[dscView->GetObject()] = {dscView, sessionId, nullptr};
+}
 
-    size_t subCacheOff = offsetof(struct dyld_cache_header, subCacheArrayOffset);
-    size_t headerEnd = header.mappingOffset;
-    if (headerEnd > subCacheOff) {
-        if (header.cacheType != 2)
+void SharedCache::UnregisterView(BinaryNinja::BinaryView* dscView)
+{
+    std::shared_ptr<SharedCache> controller;
+    {
+        std::unique_lock<std::mutex> lock(s_viewsMutex);
+        for (auto it = s_views.begin(); it != s_views.end(); ++it)
         {
-            if (std::filesystem::exists(m_baseFile->Path() + ".01"))
-                return LargeCacheFormat;
-            return SplitCacheFormat;
+            if (it->second.view == dscView)
+            {
+                controller = std::move(it->second.controller);
+                s_views.erase(it);
+                break;
+            }
         }
-        else
-            return iOS16CacheFormat;
     }
-
-    return RegularCacheFormat;
+    // `controller` (and with it the VM session, unless something else holds it) goes away out here.
 }
 
-std::string SharedCache::Serialize()
+std::shared_ptr<SharedCache> SharedCache::ControllerLocked(RegisteredView& registered)
 {
-    std::stringstream ss;
-
-    rapidjson::Document d;
-    d.SetObject();
-
-    rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+    if (!registered.controller)
+        registered.controller = std::shared_ptr<SharedCache>(new SharedCache(registered.view));
+    return registered.controller;
+}
 
-    d.AddMember("state", m_viewState, allocator);
-    d.AddMember("cursor", m_rawViewCursor, allocator);
-    rapidjson::Value loadedImages(rapidjson::kArrayType);
-    for (auto img : m_loadedImages)
+std::shared_ptr<SharedCache> SharedCache::GetFromDSCView(BinaryNinja::Ref<BinaryNinja::BinaryView> dscView)
+{
+    // Other views of the same file (the raw view, say) still get the DSCView's controller.
+    size_t sessionId = dscView->GetFile()->GetSessionId();
     {
-        loadedImages.PushBack(img.second.AsDocument(), allocator);
+        std::unique_lock<std::mutex> lock(s_viewsMutex);
+        if (auto it = s_views.find(dscView->GetObject()); it != s_views.end())
+            return ControllerLocked(it->second);
+        for (auto& [handle, registered] : s_views)
+            if (registered.sessionId == sessionId)
+                return ControllerLocked(registered);
     }
-    d.AddMember("loadedImages", loadedImages, allocator);
-
-    rapidjson::StringBuffer strbuf;
-    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(strbuf);
-    d.Accept(writer);
 
-    return strbuf.GetString();
+    auto cache = std::shared_ptr<SharedCache>(new SharedCache(dscView.GetPtr()));
+    cache->m_dscViewRef = dscView;
+    return cache;
 }
 
-void SharedCache::DeserializeFromRawView()
+std::shared_ptr<SharedCache> SharedCache::GetFromHandle(BNBinaryView* view)
 {
-    if (m_dscView->QueryMetadata(SharedCacheMetadataTag))
-    {
-        LoadFromString(m_dscView->GetStringMetadata(SharedCacheMetadataTag));
-    }
-    else
     {
-        m_viewState = Loaded;
-        m_loadedImages.clear();
-        m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
+        std::unique_lock<std::mutex> lock(s_viewsMutex);
+        if (auto it = s_views.find(view); it != s_views.end())
+            return ControllerLocked(it->second);
     }
+    return GetFromDSCView(new BinaryView(BNNewViewReference(view)));
 }
 
-SharedCache::SharedCache(BinaryNinja::Ref<BinaryNinja::BinaryView> dscView)
-    : m_dscView(dscView)
+const CacheImage* SharedCache::ImageForName(const std::string& name)
 {
-    DeserializeFromRawView();
-}
-
-SharedCache* SharedCache::GetFromDSCView(BinaryNinja::Ref<BinaryNinja::BinaryView> dscView)
-{
-    return new SharedCache(std::move(dscView));
+    if (!m_session)
+        return nullptr;
+    if (auto image = m_session->ImageWithInstallName(name))
+        return image;
+    // Let scripts say "Foundation" instead of the full framework path.
+    if (name.find('/') == std::string::npos)
+        return m_session->ImageWithBaseName(name);
+    return nullptr;
 }
 
 uint64_t SharedCache::GetImageStart(std::string installName)
 {
     auto mapLock = ScopedVMMapSession(this);
     if (!m_baseFile)
-        return false;
-    auto format = GetCacheFormat();
-    LoadedImage image;
-    image.headerBase = 0;
-
-    dyld_cache_header header{};
-    size_t header_size = m_baseFile->ReadUInt32(16);
-    m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
+        return 0;
 
-    switch (format) {
-        case RegularCacheFormat: {
-            dyld_cache_image_info img{};
-
-            for (size_t i = 0; i < header.imagesCountOld; i++) {
-                m_baseFile->Read(&img, header.imagesOffsetOld + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                if (iname == installName)
-                {
-                    image.headerBase = img.address;
-                    image.name = iname;
-                    break;
-                }
-            }
-            break;
-        }
-        case iOS16CacheFormat:
-        case SplitCacheFormat:
-        case LargeCacheFormat: {
-            dyld_cache_image_info img{};
-
-            for (size_t i = 0; i < header.imagesCount; i++) {
-                m_baseFile->Read(&img, header.imagesOffset + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                if (iname == installName)
-                {
-                    image.headerBase = img.address;
-                    image.name = iname;
-                    break;
-                }
-            }
-
-            break;
-        }
-    }
-
-    return image.headerBase;
+    if (auto image = ImageForName(installName))
+        return image->headerAddress;
+    return 0;
 }
 
 bool SharedCache::LoadSectionAtAddress(uint64_t address)
 {
-    SetupVMMap();
+    auto mapLock = ScopedVMMapSession(this);
     if (!m_baseFile)
+        return false;
+
+    auto segment = m_session->SegmentAt(address);
+    if (!segment)
     {
-        TeardownVMMap();
+        BNLogInfo("Addr 0x%llx not found", address);
         return false;
     }
-    auto vmhold = m_vm;
-    auto format = GetCacheFormat();
+
+    // A shared __LINKEDIT belongs to no one image, so there's no header to process for it.
+    bool shared = segment->imageCount > 1;
+    const auto& cacheImage = m_session->Images()[segment->imageIndex];
+    if (!cacheImage.headerAddress)
+        return false;
+
     LoadedImage image;
-    image.headerBase = 0;
-
-    dyld_cache_header header{};
-    size_t header_size = m_baseFile->ReadUInt32(16);
-    m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
-    BinaryNinja::segment_command_64 seg;
-    bool found = false;
-
-    switch (format) {
-        case RegularCacheFormat: {
-            dyld_cache_image_info img{};
-
-            for (size_t i = 0; i < header.imagesCountOld; i++) {
-                m_baseFile->Read(&img, header.imagesOffsetOld + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                BinaryNinja::mach_header_64 hdr;
-                m_vm->Read(&hdr, img.address, sizeof(BinaryNinja::mach_header_64));
-                uint64_t cursor = img.address + sizeof(BinaryNinja::mach_header_64);
-                for (auto j = 0; j < hdr.ncmds; j++)
+    image.headerBase = cacheImage.headerAddress;
+    image.name = std::string(cacheImage.installName);
+
+    ScopedUndoActions undo(m_dscView);
+    KMachOHeader h;
+    try {
+        uint64_t start = segment->start, size = segment->end - segment->start;
+        uint32_t flags = SegmentReadable | SegmentExecutable;
+
+        // Lazy loading keeps __LINKEDIT down to windows, as MapImageSegments does: the owner's window holding the
+        //  address, or for a shared one, which no image's load commands can be picked for, just the page it's on.
+        if (LazySegmentLoading() && strncmp(segment->name, "__LINKEDIT", 16) == 0)
+        {
+            uint64_t pageSize = m_session->Descriptor().pageSize;
+            start = std::max<uint64_t>(address & ~(pageSize - 1), segment->start);
+            size = std::min<uint64_t>(start + pageSize, segment->end) - start;
+            flags = SegmentReadable;
+            if (!shared)
+            {
+                for (const auto& mapping : ImageSegmentMappings(cacheImage, true))
                 {
-                    uint32_t cmdI = m_vm->ReadUInt32(cursor);
-                    uint32_t cmdS = m_vm->ReadUInt32(cursor+4);
-                    uint32_t next = cursor + cmdS;
-                    if (cmdI == LC_SEGMENT_64)
+                    if (address >= mapping.address && address - mapping.address < mapping.size)
                     {
-                        m_vm->Read(&seg, cursor, sizeof(BinaryNinja::segment_command_64));
-                        if ( seg.vmaddr <= address && seg.vmaddr + seg.vmsize > address )
-                        {
-                            found = true;
-                            image.headerBase = img.address;
-                            image.name = iname;
-                            break;
-                        }
+                        start = mapping.address;
+                        size = mapping.size;
+                        break;
                     }
-                    cursor = next;
                 }
-                if (found)
-                    break;
             }
-            break;
         }
-        case iOS16CacheFormat:
-        case SplitCacheFormat:
-        case LargeCacheFormat: {
-            dyld_cache_image_info img{};
-
-            for (size_t i = 0; i < header.imagesCount; i++) {
-
-                m_baseFile->Read(&img, header.imagesOffset + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                BinaryNinja::mach_header_64 hdr;
-                m_vm->Read(&hdr, img.address, sizeof(BinaryNinja::mach_header_64));
-                uint64_t cursor = img.address + sizeof(BinaryNinja::mach_header_64);
-                for (auto j = 0; j < hdr.ncmds; j++)
-                {
-                    uint32_t cmdI = m_vm->ReadUInt32(cursor);
-                    uint32_t cmdS = m_vm->ReadUInt32(cursor+4);
-                    uint64_t next = cursor + cmdS;
-                    if (cmdI == LC_SEGMENT_64)
-                    {
-                        m_vm->Read(&seg, cursor, sizeof(BinaryNinja::segment_command_64));
-                        if ( seg.vmaddr <= address && seg.vmaddr + seg.vmsize > address )
-                        {
-                            found = true;
-                            image.headerBase = img.address;
-                            image.name = iname;
-                            break;
-                        }
-                    }
-                    cursor = next;
-                }
-                if (found)
-                    break;
-            }
 
-            break;
-        }
+        image.loadedSegments.push_back({start, {start, start + size}});
+        m_dscView->AddUserSegment(start, size, start, size, flags);
+        if (!shared)
+            h = MachOLoader::HeaderForAddress(m_dscView, image.headerBase, image.name);
     }
-
-    if (!found)
+    catch (std::exception& exc)
     {
-        BNLogInfo("Addr 0x%llx not found", address);
-        TeardownVMMap();
+        BNLogError("Failed to map 0x%llx from %s: %s", address, image.name.c_str(), exc.what());
+        UnmapImageSegments(image);
         return false;
     }
 
-    if (!image.headerBase)
-    {
-        TeardownVMMap();
-        return false;
-    }
+    SaveToDSCView();
 
-    auto id = m_dscView->BeginUndoActions();
-    m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
-    auto reader = VMReader(m_vm);
-    reader.Seek(image.headerBase);
-    size_t headerStart = reader.Offset();
-    auto magic = reader.ReadUInt32(headerStart);
-    bool is64 = (magic == MH_MAGIC_64 || magic == MH_CIGAM_64);
+    // Headers, padding between sections, and shared __LINKEDIT have no section to add.
+    if (!shared && !m_session->SectionAt(address))
+        BNLogInfo("No section at 0x%llx in %s, only its segment was added", address, image.name.c_str());
 
-    if (is64) {
-        auto buff = reader.ReadBuffer(seg.vmaddr, seg.vmsize);
-        // wow this sucks!
-        m_dscView->GetParentView()->GetParentView()->WriteBuffer(m_dscView->GetParentView()->GetParentView()->GetEnd(), *buff);
-        m_dscView->GetParentView()->WriteBuffer(m_rawViewCursor, *buff);
-        m_dscView->GetParentView()->AddUserSegment(m_rawViewCursor, seg.vmsize, m_rawViewCursor, seg.vmsize, SegmentReadable);
-        m_dscView->AddUserSegment(seg.vmaddr, seg.vmsize, m_rawViewCursor, seg.vmsize, SegmentReadable | SegmentExecutable);
-        m_dscView->WriteBuffer(seg.vmaddr, *buff);
-        m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
-    } else
+    if (!shared)
     {
-
+        // The segment's in by now; a bad header or trie only costs its types and symbols.
+        try {
+            MachOLoader::InitializeHeader(m_dscView, h, address);
+            if (h.exportTriePresent)
+                MachOLoader::ParseExportTrie(m_vm->MappingAtAddress(h.linkeditSegment.vmaddr).first.file.get(), m_dscView, h);
+        }
+        catch (std::exception& exc)
+        {
+            BNLogError("Failed to apply the header of %s: %s", h.identifierPrefix.c_str(), exc.what());
+        }
     }
 
-    SaveToDSCView();
-
-    auto h = MachOLoader::HeaderForAddress(m_dscView, image.headerBase, image.name);
-    MachOLoader::InitializeHeader(m_dscView, h, address);
-    if (h.exportTriePresent)
-        MachOLoader::ParseExportTrie(m_vm->MappingAtAddress(h.linkeditSegment.vmaddr).first.file.get(), m_dscView, h);
-
     m_dscView->AddAnalysisOption("linearsweep");
     m_dscView->UpdateAnalysis();
-    TeardownVMMap();
-
-    m_dscView->CommitUndoActions(id);
-
     return true;
 }
 
 bool SharedCache::LoadImageWithInstallName(std::string installName)
 {
-    SetupVMMap();
-    if (!m_baseFile)
     {
-        TeardownVMMap();
-        return false;
+        auto mapLock = ScopedVMMapSession(this);
+        if (auto cacheImage = ImageForName(installName))
+            if (m_loadedImages.count(std::string(cacheImage->installName)))
+                return true;
     }
-    auto vmhold = m_vm;
-    auto format = GetCacheFormat();
-    LoadedImage image;
-    image.headerBase = 0;
-
-    dyld_cache_header header{};
-    size_t header_size = m_baseFile->ReadUInt32(16);
-    m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
+    return LoadImages({installName}) != 0;
+}
 
-    switch (format) {
-        case RegularCacheFormat: {
-            dyld_cache_image_info img{};
+bool SharedCache::LazySegmentLoading()
+{
+    auto settings = m_dscView->GetLoadSettings(m_dscView->GetTypeName());
+    if (settings && settings->Contains("loader.dsc.segmentLoading"))
+        return settings->Get<std::string>("loader.dsc.segmentLoading", m_dscView) != "eager";
+    return true;
+}
 
-            for (size_t i = 0; i < header.imagesCountOld; i++) {
-                m_baseFile->Read(&img, header.imagesOffsetOld + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                if (iname == installName)
-                {
-                    image.headerBase = img.address;
-                    image.name = iname;
-                    break;
-                }
-            }
-            break;
-        }
-        case iOS16CacheFormat:
-        case SplitCacheFormat:
-        case LargeCacheFormat: {
-            dyld_cache_image_info img{};
-
-            for (size_t i = 0; i < header.imagesCount; i++) {
-                m_baseFile->Read(&img, header.imagesOffset + (i * sizeof(img)), sizeof(img));
-                auto iname = m_baseFile->ReadNullTermString(img.pathFileOffset);
-                if (iname == installName)
-                {
-                    image.headerBase = img.address;
-                    image.name = iname;
-                    break;
-                }
-            }
+std::vector<SharedCache::SegmentMapping> SharedCache::ImageSegmentMappings(const CacheImage& cacheImage, bool lazy)
+{
+    std::vector<SegmentMapping> mappings;
+    auto reader = VMReader(m_vm);
 
-            break;
+    // Analysis reads what gets mapped right after this, so it's worth paging in up front.
+    // Not a whole shared __LINKEDIT though; that's hundreds of megabytes of mostly other images' data.
+    auto mapSegment = [&](uint64_t vmaddr, uint64_t vmsize, uint32_t flags, bool prefetch) {
+        mappings.push_back({vmaddr, vmsize, flags, prefetch});
+    };
+
+    uint64_t linkeditAddress = 0, linkeditSize = 0, linkeditFileOffset = 0;
+    // (file offset, size) of every __LINKEDIT blob this image owns.
+    std::vector<std::pair<uint64_t, uint64_t>> linkeditBlobs;
+    auto noteSegment = [&](const char* name, uint64_t vmaddr, uint64_t vmsize, uint64_t fileoff) {
+        if (vmsize >= 0x8000000)
+            return;
+        if (lazy && strncmp(name, "__LINKEDIT", 16) == 0)
+        {
+            linkeditAddress = vmaddr;
+            linkeditSize = vmsize;
+            linkeditFileOffset = fileoff;
+            return;
         }
-    }
-
-    if (!image.headerBase)
-    {
-        TeardownVMMap();
-        return false;
-    }
+        mapSegment(vmaddr, vmsize, SegmentReadable | SegmentExecutable, strncmp(name, "__LINKEDIT", 16) != 0);
+    };
 
-    auto id = m_dscView->BeginUndoActions();
-    m_viewState = LoadedWithImages;
-    m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
-    auto reader = VMReader(m_vm);
-    reader.Seek(image.headerBase);
+    reader.Seek(cacheImage.headerAddress);
     size_t headerStart = reader.Offset();
     auto magic = reader.ReadUInt32(headerStart);
     bool is64 = (magic == MH_MAGIC_64 || magic == MH_CIGAM_64);
 
-    if (is64) {
-        mach_header_64 header{};
-        reader.Read(&header, headerStart, sizeof(mach_header_64));
-        size_t off = headerStart + sizeof(mach_header_64);
-        for (size_t i = 0; i < header.ncmds; i++) {
-            size_t lc = reader.ReadUInt32(off);
-            size_t bump = reader.ReadUInt32();
-            if (lc == LC_SEGMENT_64) {
+    mach_header header{};
+    reader.Read(&header, headerStart, sizeof(mach_header));
+    size_t off = headerStart + (is64 ? sizeof(mach_header_64) : sizeof(mach_header));
+    for (size_t i = 0; i < header.ncmds; i++) {
+        size_t lc = reader.ReadUInt32(off);
+        size_t bump = reader.ReadUInt32();
+        switch (lc)
+        {
+            case LC_SEGMENT_64: {
                 segment_command_64 cmd{};
                 reader.Read(&cmd, off, sizeof(segment_command_64));
-                if (cmd.vmsize >= 0x8000000)
-                    continue;
-                auto buff = reader.ReadBuffer(cmd.vmaddr, cmd.vmsize);
-                // wow this sucks!
-                m_dscView->GetParentView()->GetParentView()->WriteBuffer(m_dscView->GetParentView()->GetParentView()->GetEnd(), *buff);
-                m_dscView->GetParentView()->WriteBuffer(m_rawViewCursor, *buff);
-                image.loadedSegments.push_back({m_rawViewCursor, {cmd.vmaddr, cmd.vmaddr + cmd.vmsize}});
-                m_dscView->GetParentView()->AddUserSegment(m_rawViewCursor, cmd.vmsize, m_rawViewCursor, cmd.vmsize, SegmentReadable);
-                m_dscView->AddUserSegment(cmd.vmaddr, cmd.vmsize, m_rawViewCursor, cmd.vmsize, SegmentReadable | SegmentExecutable);
-                m_dscView->WriteBuffer(cmd.vmaddr, *buff);
-                m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
+                noteSegment(cmd.segname, cmd.vmaddr, cmd.vmsize, cmd.fileoff);
+                break;
             }
-            off += bump;
-        }
-    } else {
-        mach_header header{};
-        reader.Read(&header, headerStart, sizeof(mach_header));
-        size_t off = headerStart + sizeof(mach_header);
-        for (size_t i = 0; i < header.ncmds; i++) {
-            size_t lc = reader.ReadUInt32(off);
-            size_t bump = reader.ReadUInt32();
-            if (lc == LC_SEGMENT) {
+            case LC_SEGMENT: {
                 segment_command cmd{};
                 reader.Read(&cmd, off, sizeof(segment_command));
-                if (cmd.vmsize >= 0x8000000)
-                    continue;
-                auto buff = reader.ReadBuffer(cmd.vmaddr, cmd.vmsize);
-                m_dscView->GetParentView()->WriteBuffer(m_rawViewCursor, *buff);
-                image.loadedSegments.push_back({m_rawViewCursor, {cmd.vmaddr, cmd.vmaddr + cmd.vmsize}});
-                m_dscView->GetParentView()->AddUserSegment(m_rawViewCursor, cmd.vmsize, m_rawViewCursor, cmd.vmsize, SegmentReadable);
-                m_dscView->AddUserSegment(cmd.vmaddr, cmd.vmsize, m_rawViewCursor, cmd.vmsize, SegmentReadable | SegmentExecutable);
-                m_dscView->WriteBuffer(cmd.vmaddr, *buff);
-                m_rawViewCursor = m_dscView->GetParentView()->GetEnd();
+                noteSegment(cmd.segname, cmd.vmaddr, cmd.vmsize, cmd.fileoff);
+                break;
+            }
+            case LC_SYMTAB: {
+                // Just the nlists; the string pool is shared by the whole cache.
+                symtab_command cmd{};
+                reader.Read(&cmd, off, sizeof(symtab_command));
+                linkeditBlobs.push_back({cmd.symoff, (uint64_t)cmd.nsyms * (is64 ? sizeof(nlist_64) : 12)});
+                break;
+            }
+            case LC_DYSYMTAB: {
+                dysymtab_command cmd{};
+                reader.Read(&cmd, off, sizeof(dysymtab_command));
+                linkeditBlobs.push_back({cmd.indirectsymoff, (uint64_t)cmd.nindirectsyms * sizeof(uint32_t)});
+                break;
+            }
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                dyld_info_command cmd{};
+                reader.Read(&cmd, off, sizeof(dyld_info_command));
+                linkeditBlobs.push_back({cmd.rebase_off, cmd.rebase_size});
+                linkeditBlobs.push_back({cmd.bind_off, cmd.bind_size});
+                linkeditBlobs.push_back({cmd.weak_bind_off, cmd.weak_bind_size});
+                linkeditBlobs.push_back({cmd.lazy_bind_off, cmd.lazy_bind_size});
+                linkeditBlobs.push_back({cmd.export_off, cmd.export_size});
+                break;
+            }
+            case LC_FUNCTION_STARTS:
+            case LC_DATA_IN_CODE:
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS: {
+                linkedit_data_command cmd{};
+                reader.Read(&cmd, off, sizeof(linkedit_data_command));
+                linkeditBlobs.push_back({cmd.dataoff, cmd.datasize});
+                break;
             }
-            off += bump;
+            default:
+                break;
         }
+        off += bump;
+    }
+
+    if (!linkeditAddress)
+        return mappings;
+
+    /*
+     * Every image in a (sub)cache shares one __LINKEDIT, often hundreds of megabytes. Rather than putting all of it
+     *  in front of analysis, expose page-rounded windows over just the blobs this image's load commands point at.
+     */
+    uint64_t pageMask = m_session->Descriptor().pageSize - 1;
+    std::vector<std::pair<uint64_t, uint64_t>> windows;
+    for (const auto& [fileOffset, size] : linkeditBlobs)
+    {
+        if (!size || fileOffset < linkeditFileOffset || fileOffset - linkeditFileOffset >= linkeditSize)
+            continue;
+        uint64_t start = linkeditAddress + (fileOffset - linkeditFileOffset);
+        uint64_t end = std::min(start + size, linkeditAddress + linkeditSize);
+        windows.push_back({std::max<uint64_t>(start & ~pageMask, linkeditAddress),
+                           std::min<uint64_t>((end + pageMask) & ~pageMask, linkeditAddress + linkeditSize)});
+    }
+    std::sort(windows.begin(), windows.end());
+    for (size_t i = 0; i < windows.size(); i++)
+    {
+        uint64_t start = windows[i].first, end = windows[i].second;
+        while (i + 1 < windows.size() && windows[i + 1].first <= end)
+            end = std::max(end, windows[++i].second);
+        mapSegment(start, end - start, SegmentReadable, true);
+    }
+    return mappings;
+}
+
+void SharedCache::MapImageSegments(const CacheImage& cacheImage, bool lazy, LoadedImage& image)
+{
+    image.headerBase = cacheImage.headerAddress;
+    image.name = std::string(cacheImage.installName);
+
+    // The raw view serves the cache's VM address space directly, so a segment is just a 1:1 mapping onto it.
+    for (const auto& mapping : ImageSegmentMappings(cacheImage, lazy))
+    {
+        image.loadedSegments.push_back({mapping.address, {mapping.address, mapping.address + mapping.size}});
+        if (mapping.prefetch)
+            m_vm->Prefetch(mapping.address, mapping.size);
+        m_dscView->AddUserSegment(mapping.address, mapping.size, mapping.address, mapping.size, mapping.flags);
     }
+}
+
+void SharedCache::UnmapImageSegments(const LoadedImage& image)
+{
+    for (const auto& [offset, range] : image.loadedSegments)
+        m_dscView->RemoveUserSegment(range.first, range.second - range.first);
+}
+
+size_t SharedCache::LoadImages(std::vector<std::string> installNames, size_t dependencyDepth)
+{
+    auto mapLock = ScopedVMMapSession(this);
+    if (!m_baseFile)
+        return 0;
+
+    bool firstLoad = m_loadedImages.empty();
+    bool lazy = LazySegmentLoading();
+
+    ScopedUndoActions undo(m_dscView);
+
+    // Map everything first, following LC_LOAD_DYLIBs breadth first, then run the (expensive) passes once over the batch.
+    std::vector<KMachOHeader> headers;
+    std::unordered_set<std::string> queued;
+    std::vector<std::pair<std::string, size_t>> queue;
+    for (auto& name : installNames)
+        if (queued.insert(name).second)
+            queue.push_back({name, 0});
 
-    if (m_loadedImages.empty())
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        auto [name, depth] = queue[i];
+        auto cacheImage = ImageForName(name);
+        if (!cacheImage)
+        {
+            BNLogWarn("No image named %s in this cache", name.c_str());
+            continue;
+        }
+        auto installName = std::string(cacheImage->installName);
+        if (m_loadedImages.count(installName))
+            continue;
+
+        // Only recorded once its segments and header are in; a failure backs out whatever was added for it.
+        LoadedImage image;
+        KMachOHeader h;
+        try {
+            MapImageSegments(*cacheImage, lazy, image);
+            h = MachOLoader::HeaderForAddress(m_dscView, image.headerBase, image.name);
+        }
+        catch (std::exception& exc)
+        {
+            BNLogError("Failed to map %s: %s", installName.c_str(), exc.what());
+            UnmapImageSegments(image);
+            continue;
+        }
+
+        m_loadOrder.push_back(image.name);
+        m_loadedImages[image.name] = image;
+        m_loadedImageCount = m_loadedImages.size();
+        if (depth < dependencyDepth)
+        {
+            for (const auto& dylib : h.dylibs)
+                if (queued.insert(dylib).second)
+                    queue.push_back({dylib, depth + 1});
+        }
+        headers.push_back(h);
+    }
+
+    if (headers.empty())
+        return 0;
+
+    if (firstLoad)
     {
         auto seg = m_dscView->GetSegmentAt(0);
         if (seg)
             m_dscView->RemoveAutoSegment(0, seg->GetLength());
     }
 
-    m_loadedImages[image.name] = image;
+    m_viewState = LoadedWithImages;
     SaveToDSCView();
 
-    auto h = MachOLoader::HeaderForAddress(m_dscView, image.headerBase, image.name);
-    MachOLoader::InitializeHeader(m_dscView, h);
-    if (h.exportTriePresent)
-        MachOLoader::ParseExportTrie(m_vm->MappingAtAddress(h.linkeditSegment.vmaddr).first.file.get(), m_dscView, h);
+    for (const auto& h : headers)
+    {
+        // The image's segments are in by now; a bad header or trie only costs its types and symbols.
+        try {
+            MachOLoader::InitializeHeader(m_dscView, h);
+            if (h.exportTriePresent)
+                MachOLoader::ParseExportTrie(m_vm->MappingAtAddress(h.linkeditSegment.vmaddr).first.file.get(), m_dscView, h);
+        }
+        catch (std::exception& exc)
+        {
+            BNLogError("Failed to apply the header of %s: %s", h.identifierPrefix.c_str(), exc.what());
+        }
+    }
 
-    auto objc = new ObjCProcessing(m_dscView, this, m_vm);
-    objc->LoadObjCMetadata(h);
+    ObjCProcessing objc(m_dscView, this, m_vm);
+    for (auto& h : headers)
+        objc.LoadObjCMetadata(h);
 
     m_dscView->AddAnalysisOption("linearsweep");
     m_dscView->UpdateAnalysis();
-    TeardownVMMap();
-
-    m_dscView->CommitUndoActions(id);
 
-    return true;
+    return headers.size();
 }
 
 std::string base_name(std::string const & path)
@@ -1331,137 +1200,175 @@ void MachOLoader::InitializeHeader(Ref<BinaryView> view, KMachOHeader header, ui
     }
 }
 
-std::vector<ExportTrieEntryStart> ReadExportNode(DataBuffer& buffer, std::vector<ExportNode>& results, const std::string& currentText, size_t cursor, uint32_t endGuard)
+void MachOLoader::ParseExportTrie(MMappedFileAccessor* linkeditFile, Ref<BinaryView> view, KMachOHeader header)
 {
-    if (cursor > endGuard)
-        throw ReadException();
+    if (!linkeditFile || (size_t)header.exportTrie.dataoff + header.exportTrie.datasize > linkeditFile->Length())
+    {
+        BNLogError("Export trie for %s is out of bounds", header.identifierPrefix.c_str());
+        return;
+    }
+    auto trie = (const uint8_t*)linkeditFile->Data() + header.exportTrie.dataoff;
+
+    // Sorted (start, end, flags) so picking the symbol type for an export is a binary search.
+    struct SectionRange {
+        uint64_t start;
+        uint64_t end;
+        uint32_t flags;
+    };
+    std::vector<SectionRange> sections;
+    sections.reserve(header.sections.size());
+    for (const auto& s : header.sections)
+        sections.push_back({s.addr, s.addr + s.size, s.flags});
+    std::sort(sections.begin(), sections.end(), [](const SectionRange& a, const SectionRange& b) {
+        return a.start < b.start;
+    });
+
+    view->BeginBulkModifySymbols();
+    try {
+        ExportTrie::ForEachExport(trie, header.exportTrie.datasize, [&](const std::string& name, uint64_t flags, uint64_t offset) {
+            if (name.empty() || !offset)
+                return;
+            uint64_t address = ExportTrie::ExportAddress(header.textBase, flags, offset);
+
+            BNSymbolType type = DataSymbol;
+            auto it = std::upper_bound(sections.begin(), sections.end(), address, [](uint64_t address, const SectionRange& s) {
+                return address < s.start;
+            });
+            if (it != sections.begin() && address < (it - 1)->end)
+            {
+                uint32_t sectionFlags = (it - 1)->flags;
+                if ((sectionFlags & S_ATTR_PURE_INSTRUCTIONS) == S_ATTR_PURE_INSTRUCTIONS ||
+                    (sectionFlags & S_ATTR_SOME_INSTRUCTIONS) == S_ATTR_SOME_INSTRUCTIONS)
+                    type = FunctionSymbol;
+            }
+            // User symbols, so they're saved with the database; nothing re-parses the trie on reopen.
+            view->DefineUserSymbol(new Symbol(type, name, address));
+        });
+    } catch (ExportTrieException &e) {
+        BNLogError("Failed to load Export Trie for %s", header.identifierPrefix.c_str());
+    }
+    view->EndBulkModifySymbols();
+}
+
+uint64_t SharedCache::GetObjCSelectorAddress(const std::string& name)
+{
+    auto mapLock = ScopedVMMapSession(this);
+    if (!m_session)
+        return 0;
 
-    uint64_t terminalSize = readValidULEB128(buffer, cursor);
-    if (terminalSize != 0) {
-        uint64_t imageOffset = 0;
-        uint64_t flags = readValidULEB128(buffer, cursor);
-        if (!(flags & EXPORT_SYMBOL_FLAGS_REEXPORT))
+    if (auto opts = m_session->GetObjCOptimizations())
+        if (auto address = opts->SelectorAddress(name))
+            return *address;
+    return 0;
+}
+
+std::vector<std::pair<std::string, uint64_t>> SharedCache::GetObjCClassLocations(const std::string& name)
+{
+    auto mapLock = ScopedVMMapSession(this);
+    if (!m_session)
+        return {};
+
+    std::vector<std::pair<std::string, uint64_t>> locations;
+    if (auto opts = m_session->GetObjCOptimizations())
+    {
+        for (auto address : opts->ClassAddresses(name))
         {
-            imageOffset = readValidULEB128(buffer, cursor);
-            results.push_back({currentText, imageOffset, flags});
+            std::string installName;
+            if (auto segment = m_session->SegmentAt(address); segment && segment->imageCount == 1)
+                installName = m_session->Images()[segment->imageIndex].installName;
+            locations.emplace_back(installName, address);
         }
     }
-    uint8_t childCount = buffer[cursor];
-    cursor++;
-    if (cursor > endGuard)
-        throw ReadException();
+    return locations;
+}
 
-    std::vector<ExportTrieEntryStart> entries;
-    for (uint8_t i = 0; i < childCount; ++i)
+// Last path component of an install name.
+static std::string_view ImageBaseName(std::string_view installName)
+{
+    auto slash = installName.rfind('/');
+    return slash == std::string_view::npos ? installName : installName.substr(slash + 1);
+}
+
+std::shared_ptr<SymbolIndex> SharedCache::WaitForSymbolIndex()
+{
+    std::shared_ptr<CacheSession> session;
     {
-        std::string childText;
-        while (buffer[cursor] != 0 & cursor <= endGuard)
-            childText.push_back(buffer[cursor++]);
-        cursor++;
-        if (cursor > endGuard)
-            throw ReadException();
-        auto next = readValidULEB128(buffer, cursor);
-        if (next == 0)
-            throw ReadException();
-        entries.push_back({currentText + childText, next});
+        auto mapLock = ScopedVMMapSession(this);
+        session = m_session;
     }
-    return entries;
+    return session ? session->GetSymbolIndex() : nullptr;
 }
 
-void MachOLoader::ParseExportTrie(MMappedFileAccessor* linkeditFile, Ref<BinaryView> view, KMachOHeader header)
+uint64_t SharedCache::GetSymbolAddress(const std::string& name)
 {
-    try {
-        MMappedFileAccessor *reader = linkeditFile;
-
-        std::string startText = "";
-        std::vector<ExportNode> nodes;
-        DataBuffer* buffer = reader->ReadBuffer(header.exportTrie.dataoff, header.exportTrie.datasize);
-        std::deque<ExportTrieEntryStart> entries;
-        entries.push_back({"", 0});
-        while (!entries.empty())
-        {
-            for (std::deque<ExportTrieEntryStart>::iterator it = entries.begin(); it != entries.end();)
-            {
-                ExportTrieEntryStart entry = *it;
-                it = entries.erase(it);
+    auto index = WaitForSymbolIndex();
+    if (!index)
+        return 0;
+    auto mapLock = ScopedVMMapSession(this);
 
-                for (const auto& newEntry : ReadExportNode(*buffer, nodes, entry.currentText,
-                                                           entry.cursorPosition, header.exportTrie.datasize))
-                    entries.push_back(newEntry);
-            }
-        }
+    std::string_view symbol = name;
+    std::string_view imageName;
+    if (auto bang = symbol.find('!'); bang != std::string_view::npos)
+    {
+        imageName = symbol.substr(0, bang);
+        symbol = symbol.substr(bang + 1);
+    }
 
-        for (const auto &n: nodes) {
-            if (!n.text.empty() && n.offset) {
-                uint32_t flags;
-                BNSymbolType type = DataSymbol;
-                auto found = false;
-                for (auto s: header.sections) {
-                    if (s.addr < n.offset) {
-                        if (s.addr + s.size > n.offset) {
-                            flags = s.flags;
-                            found = true;
-                        }
-                    }
-                }
-                if ((flags & S_ATTR_PURE_INSTRUCTIONS) == S_ATTR_PURE_INSTRUCTIONS ||
-                    (flags & S_ATTR_SOME_INSTRUCTIONS) == S_ATTR_SOME_INSTRUCTIONS)
-                    type = FunctionSymbol;
-                else
-                    type = DataSymbol;
-#if EXPORT_TRIE_DEBUG
-                // BNLogInfo("export: %s -> 0x%llx", n.text.c_str(), image.baseAddress + n.offset);
-#endif
-                // view->DefineMachoSymbol(type, n.text, header.textBase + n.offset, NoBinding, false);
-                BNLogInfo("0x%llx %s", header.textBase + n.offset, n.text.c_str());
-                view->DefineUserSymbol(new Symbol(DataSymbol, n.text, header.textBase + n.offset));
-            }
-        }
-    } catch (std::exception &e) {
-        BNLogError("Failed to load Export Trie");
+    for (const auto& candidate : index->SymbolsNamed(symbol))
+    {
+        if (imageName.empty())
+            return candidate.address;
+        auto installName = m_session->Images()[candidate.imageIndex].installName;
+        if (installName == imageName || ImageBaseName(installName) == imageName)
+            return candidate.address;
     }
+    return 0;
 }
 
-std::vector<std::string> SharedCache::GetAvailableImages()
+std::string SharedCache::SymbolizeAddress(uint64_t address)
 {
-    std::vector<std::string> installNames;
-
+    auto index = WaitForSymbolIndex();
     auto mapLock = ScopedVMMapSession(this);
-    auto format = GetCacheFormat();
-
-    if (!m_baseFile)
+    if (!m_session)
         return {};
-    dyld_cache_header header{};
-    size_t header_size = m_baseFile->ReadUInt32(16);
-    m_baseFile->Read(&header, 0, std::min(header_size, sizeof(dyld_cache_header)));
 
-    switch (format) {
-        case RegularCacheFormat: {
-            dyld_cache_image_info image{};
+    // Nothing in a shared __LINKEDIT can be pinned on one image.
+    auto segment = m_session->SegmentAt(address);
+    if (!segment || segment->imageCount > 1)
+        return {};
+    const auto& image = m_session->Images()[segment->imageIndex];
+    std::string result(ImageBaseName(image.installName));
 
-            for (size_t i = 0; i < header.imagesCountOld; i++) {
-                m_baseFile->Read(&image, header.imagesOffsetOld + (i * sizeof(image)), sizeof(image));
-                auto iname = m_baseFile->ReadNullTermString(image.pathFileOffset);
+    // The nearest preceding symbol may belong to the image before this one; only use it if it's ours.
+    SymbolIndex::Symbol symbol;
+    uint64_t base = image.headerAddress;
+    if (index && index->SymbolAt(address, symbol) && symbol.imageIndex == segment->imageIndex)
+    {
+        result += "!";
+        result += symbol.name;
+        base = symbol.address;
+    }
 
-                installNames.push_back(iname);
-            }
-            break;
-        }
-        case iOS16CacheFormat:
-        case SplitCacheFormat:
-        case LargeCacheFormat: {
-            dyld_cache_image_info image{};
+    if (address != base)
+    {
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+0x%llx", (unsigned long long)(address - base));
+        result += offset;
+    }
+    return result;
+}
 
-            for (size_t i = 0; i < header.imagesCount; i++) {
-                m_baseFile->Read(&image, header.imagesOffset + (i * sizeof(image)), sizeof(image));
-                auto iname = m_baseFile->ReadNullTermString(image.pathFileOffset);
+std::vector<std::string> SharedCache::GetAvailableImages()
+{
+    std::vector<std::string> installNames;
 
-                installNames.push_back(iname);
-            }
+    auto mapLock = ScopedVMMapSession(this);
+    if (!m_baseFile)
+        return {};
 
-            break;
-        }
-    }
+    installNames.reserve(m_session->Images().size());
+    for (const auto& image : m_session->Images())
+        installNames.emplace_back(image.installName);
 
     return installNames;
 }
@@ -1473,9 +1380,7 @@ bool BNDSCViewLoadImageWithInstallName(BNBinaryView* view, char* name)
 {
     std::string imageName = std::string(name);
     BNFreeString(name);
-    auto rawView = new BinaryView(view);
-
-    if (auto cache = SharedCache::GetFromDSCView(rawView))
+    if (auto cache = SharedCache::GetFromHandle(view))
     {
         return cache->LoadImageWithInstallName(imageName);
     }
@@ -1485,9 +1390,7 @@ bool BNDSCViewLoadImageWithInstallName(BNBinaryView* view, char* name)
 
 bool BNDSCViewLoadSectionAtAddress(BNBinaryView* view, uint64_t addr)
 {
-    auto rawView = new BinaryView(view);
-
-    if (auto cache = SharedCache::GetFromDSCView(rawView))
+    if (auto cache = SharedCache::GetFromHandle(view))
     {
         return cache->LoadSectionAtAddress(addr);
     }
@@ -1497,9 +1400,7 @@ bool BNDSCViewLoadSectionAtAddress(BNBinaryView* view, uint64_t addr)
 
 char **BNDSCViewGetInstallNames(BNBinaryView *view, size_t *count)
 {
-    auto rawView = new BinaryView(view);
-
-    if (auto cache = SharedCache::GetFromDSCView(rawView))
+    if (auto cache = SharedCache::GetFromHandle(view))
     {
         auto value = cache->GetAvailableImages();
         *count = value.size();
@@ -1515,14 +1416,91 @@ char **BNDSCViewGetInstallNames(BNBinaryView *view, size_t *count)
     return nullptr;
 }
 
-uint64_t BNDSCViewLoadedImageCount(BNBinaryView *view)
+uint64_t BNDSCViewLoadImages(BNBinaryView* view, char** names, size_t count, size_t dependencyDepth)
+{
+    std::vector<std::string> installNames;
+    for (size_t i = 0; i < count; i++)
+        installNames.emplace_back(names[i]);
+    BNFreeStringList(names, count);
+    if (auto cache = SharedCache::GetFromHandle(view))
+    {
+        return cache->LoadImages(installNames, dependencyDepth);
+    }
+
+    return 0;
+}
+
+uint64_t BNDSCViewGetObjCSelectorAddress(BNBinaryView* view, char* name)
 {
+    std::string selector = std::string(name);
+    BNFreeString(name);
+    if (auto cache = SharedCache::GetFromHandle(view))
+    {
+        return cache->GetObjCSelectorAddress(selector);
+    }
 
-    auto rawView = new BinaryView(view);
+    return 0;
+}
 
-    if (auto cache = SharedCache::GetFromDSCView(rawView))
+BNDSCObjCClassLocation* BNDSCViewGetObjCClassLocations(BNBinaryView* view, char* name, size_t* count)
+{
+    std::string className = std::string(name);
+    BNFreeString(name);
+    *count = 0;
+    if (auto cache = SharedCache::GetFromHandle(view))
     {
-        return cache->LoadedImages().size();
+        auto value = cache->GetObjCClassLocations(className);
+        if (value.empty())
+            return nullptr;
+
+        *count = value.size();
+        auto locations = new BNDSCObjCClassLocation[value.size()];
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            locations[i].imageName = BNAllocString(value[i].first.c_str());
+            locations[i].address = value[i].second;
+        }
+        return locations;
+    }
+    return nullptr;
+}
+
+void BNDSCFreeObjCClassLocations(BNDSCObjCClassLocation* locations, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        BNFreeString(locations[i].imageName);
+    delete[] locations;
+}
+
+uint64_t BNDSCViewGetSymbolAddress(BNBinaryView* view, char* name)
+{
+    std::string symbolName = std::string(name);
+    BNFreeString(name);
+    if (auto cache = SharedCache::GetFromHandle(view))
+    {
+        return cache->GetSymbolAddress(symbolName);
+    }
+
+    return 0;
+}
+
+char* BNDSCViewSymbolizeAddress(BNBinaryView* view, uint64_t address)
+{
+    if (auto cache = SharedCache::GetFromHandle(view))
+    {
+        auto value = cache->SymbolizeAddress(address);
+        if (!value.empty())
+            return BNAllocString(value.c_str());
+    }
+
+    return nullptr;
+}
+
+uint64_t BNDSCViewLoadedImageCount(BNBinaryView *view)
+{
+    if (auto cache = SharedCache::GetFromHandle(view))
+    {
+        return cache->LoadedImageCount();
     }
 
     return 0;
@@ -1534,7 +1512,21 @@ DSCRawViewType *g_dscRawViewType;
 
 #ifdef BUILD_SHAREDCACHE
 
+static void ForwardCoreLog(CoreLogLevel level, const char* message)
+{
+    switch (level)
+    {
+        case CoreInfoLog: BNLogInfo("%s", message); break;
+        case CoreWarningLog: BNLogWarn("%s", message); break;
+        case CoreErrorLog: BNLogError("%s", message); break;
+    }
+}
+
 void InitDSCViewType() {
+    // The cache engine doesn't know about Binary Ninja; hand it our log and somewhere to keep its index files.
+    SetCoreLogSink(ForwardCoreLog);
+    IndexCacheFile::SetDirectory(GetUserDirectory() + "/dscindex");
+
     static DSCRawViewType rawType;
     BinaryViewType::Register(&rawType);
     static DSCViewType type;
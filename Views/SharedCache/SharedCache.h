@@ -2,116 +2,20 @@
 // Created by kat on 5/19/23.
 //
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 #include <binaryninjaapi.h>
 #include "LoadedImage.h"
 #include "DSCView.h"
-#include "VM.h"
+#include "Core/VM.h"
+#include "Core/CacheHeader.h"
+#include "Core/CacheSession.h"
 #include "Views/MachO/machoview.h"
 
 #ifndef KSUITE_SHAREDCACHE_H
 #define KSUITE_SHAREDCACHE_H
 
-struct __attribute__((packed)) dyld_cache_mapping_info {
-    uint64_t    address;
-    uint64_t    size;
-    uint64_t    fileOffset;
-    uint32_t    maxProt;
-    uint32_t    initProt;
-};
-
-struct __attribute__((packed)) dyld_cache_image_info
-{
-    uint64_t    address;
-    uint64_t    modTime;
-    uint64_t    inode;
-    uint32_t    pathFileOffset;
-    uint32_t    pad;
-};
-
-
-struct __attribute__((packed)) dyld_cache_header
-{
-    char        magic[16];              // e.g. "dyld_v0    i386"
-    uint32_t    mappingOffset;          // file offset to first dyld_cache_mapping_info
-    uint32_t    mappingCount;           // number of dyld_cache_mapping_info entries
-    uint32_t    imagesOffsetOld;        // UNUSED: moved to imagesOffset to prevent older dsc_extarctors from crashing
-    uint32_t    imagesCountOld;         // UNUSED: moved to imagesCount to prevent older dsc_extarctors from crashing
-    uint64_t    dyldBaseAddress;        // base address of dyld when cache was built
-    uint64_t    codeSignatureOffset;    // file offset of code signature blob
-    uint64_t    codeSignatureSize;      // size of code signature blob (zero means to end of file)
-    uint64_t    slideInfoOffsetUnused;  // unused.  Used to be file offset of kernel slid info
-    uint64_t    slideInfoSizeUnused;    // unused.  Used to be size of kernel slid info
-    uint64_t    localSymbolsOffset;     // file offset of where local symbols are stored
-    uint64_t    localSymbolsSize;       // size of local symbols information
-    uint8_t     uuid[16];               // unique value for each shared cache file
-    uint64_t    cacheType;              // 0 for development, 1 for production // Kat: , 2 for iOS 16?
-    uint32_t    branchPoolsOffset;      // file offset to table of uint64_t pool addresses
-    uint32_t    branchPoolsCount;       // number of uint64_t entries
-    uint64_t    accelerateInfoAddr;     // (unslid) address of optimization info
-    uint64_t    accelerateInfoSize;     // size of optimization info
-    uint64_t    imagesTextOffset;       // file offset to first dyld_cache_image_text_info
-    uint64_t    imagesTextCount;        // number of dyld_cache_image_text_info entries
-    uint64_t    patchInfoAddr;          // (unslid) address of dyld_cache_patch_info
-    uint64_t    patchInfoSize;          // Size of all of the patch information pointed to via the dyld_cache_patch_info
-    uint64_t    otherImageGroupAddrUnused;    // unused
-    uint64_t    otherImageGroupSizeUnused;    // unused
-    uint64_t    progClosuresAddr;       // (unslid) address of list of program launch closures
-    uint64_t    progClosuresSize;       // size of list of program launch closures
-    uint64_t    progClosuresTrieAddr;   // (unslid) address of trie of indexes into program launch closures
-    uint64_t    progClosuresTrieSize;   // size of trie of indexes into program launch closures
-    uint32_t    platform;               // platform number (macOS=1, etc)
-    uint32_t    formatVersion          : 8,  // dyld3::closure::kFormatVersion
-    dylibsExpectedOnDisk   : 1,  // dyld should expect the dylib exists on disk and to compare inode/mtime to see if cache is valid
-    simulator              : 1,  // for simulator of specified platform
-    locallyBuiltCache      : 1,  // 0 for B&I built cache, 1 for locally built cache
-    builtFromChainedFixups : 1,  // some dylib in cache was built using chained fixups, so patch tables must be used for overrides
-    padding                : 20; // TBD
-    uint64_t    sharedRegionStart;      // base load address of cache if not slid
-    uint64_t    sharedRegionSize;       // overall size required to map the cache and all subCaches, if any
-    uint64_t    maxSlide;               // runtime slide of cache can be between zero and this value
-    uint64_t    dylibsImageArrayAddr;   // (unslid) address of ImageArray for dylibs in this cache
-    uint64_t    dylibsImageArraySize;   // size of ImageArray for dylibs in this cache
-    uint64_t    dylibsTrieAddr;         // (unslid) address of trie of indexes of all cached dylibs
-    uint64_t    dylibsTrieSize;         // size of trie of cached dylib paths
-    uint64_t    otherImageArrayAddr;    // (unslid) address of ImageArray for dylibs and bundles with dlopen closures
-    uint64_t    otherImageArraySize;    // size of ImageArray for dylibs and bundles with dlopen closures
-    uint64_t    otherTrieAddr;          // (unslid) address of trie of indexes of all dylibs and bundles with dlopen closures
-    uint64_t    otherTrieSize;          // size of trie of dylibs and bundles with dlopen closures
-    uint32_t    mappingWithSlideOffset; // file offset to first dyld_cache_mapping_and_slide_info
-    uint32_t    mappingWithSlideCount;  // number of dyld_cache_mapping_and_slide_info entries
-    uint64_t    dylibsPBLStateArrayAddrUnused;    // unused
-    uint64_t    dylibsPBLSetAddr;           // (unslid) address of PrebuiltLoaderSet of all cached dylibs
-    uint64_t    programsPBLSetPoolAddr;     // (unslid) address of pool of PrebuiltLoaderSet for each program
-    uint64_t    programsPBLSetPoolSize;     // size of pool of PrebuiltLoaderSet for each program
-    uint64_t    programTrieAddr;            // (unslid) address of trie mapping program path to PrebuiltLoaderSet
-    uint32_t    programTrieSize;
-    uint32_t    osVersion;                  // OS Version of dylibs in this cache for the main platform
-    uint32_t    altPlatform;                // e.g. iOSMac on macOS
-    uint32_t    altOsVersion;               // e.g. 14.0 for iOSMac
-    uint64_t    swiftOptsOffset;        // file offset to Swift optimizations header
-    uint64_t    swiftOptsSize;          // size of Swift optimizations header
-    uint32_t    subCacheArrayOffset;    // file offset to first dyld_subcache_entry
-    uint32_t    subCacheArrayCount;     // number of subCache entries
-    uint8_t     symbolFileUUID[16];     // unique value for the shared cache file containing unmapped local symbols
-    uint64_t    rosettaReadOnlyAddr;    // (unslid) address of the start of where Rosetta can add read-only/executable data
-    uint64_t    rosettaReadOnlySize;    // maximum size of the Rosetta read-only/executable region
-    uint64_t    rosettaReadWriteAddr;   // (unslid) address of the start of where Rosetta can add read-write data
-    uint64_t    rosettaReadWriteSize;   // maximum size of the Rosetta read-write region
-    uint32_t    imagesOffset;           // file offset to first dyld_cache_image_info
-    uint32_t    imagesCount;            // number of dyld_cache_image_info entries
-};
-
-struct __attribute__((packed)) dyld_subcache_entry {
-    char uuid[16];
-    uint64_t address;
-};
-
-struct __attribute__((packed)) dyld_subcache_entry2 {
-    char uuid[16];
-    uint64_t address;
-    char fileExtension[32];
-};
-
 using namespace BinaryNinja;
 struct KMachOHeader {
     uint64_t textBase = 0;
@@ -167,8 +71,6 @@ class SharedCache : public MetadataSerializable
     friend ScopedVMMapSession;
     /* VIEW STATE BEGIN -- SERIALIZE ALL OF THIS AND STORE IT IN RAW VIEW */
 
-    uint64_t m_rawViewCursor = 0;
-
     enum ViewState : uint8_t {
         Unloaded,
         Loaded,
@@ -176,22 +78,50 @@ class SharedCache : public MetadataSerializable
     } m_viewState;
 
     std::map<std::string, LoadedImage> m_loadedImages;
+    // Install names in load order; the first m_persistedImageCount of them already have a record in the view.
+    std::vector<std::string> m_loadOrder;
+    size_t m_persistedImageCount = 0;
 
     /* VIEWSTATE END */
 
     /* API VIEW START */
-    BinaryNinja::Ref<BinaryNinja::BinaryView> m_dscView;
+    // The DSCView that owns this controller. Not a reference, or the view could never be freed; controllers
+    //  handed out for views that aren't registered keep theirs alive through m_dscViewRef instead.
+    BinaryNinja::BinaryView* m_dscView;
+    BinaryNinja::Ref<BinaryNinja::BinaryView> m_dscViewRef;
     /* API VIEW END */
 
+    /* CONTROLLER REGISTRY START */
+    // One live controller per open DSCView, so API calls share its state. Keyed by the view's core handle, which
+    //  is what the C API is called with, so finding a registered view needs no wrapper object.
+    struct RegisteredView {
+        BinaryNinja::BinaryView* view;
+        size_t sessionId;
+        std::shared_ptr<SharedCache> controller; // created on first use
+    };
+    static std::mutex s_viewsMutex;
+    static std::unordered_map<BNBinaryView*, RegisteredView> s_views;
+    // Caller holds s_viewsMutex.
+    static std::shared_ptr<SharedCache> ControllerLocked(RegisteredView& registered);
+
+    // Serializes API calls against this controller; held for as long as a ScopedVMMapSession is.
+    std::recursive_mutex m_mutex;
+    std::atomic<size_t> m_loadedImageCount {0};
+    /* CONTROLLER REGISTRY END */
+
     /* VM READER START */
-    bool m_pagesMapped;
+    std::shared_ptr<CacheSession> m_session;
+    size_t m_sessionDepth = 0;
     std::shared_ptr<MMappedFileAccessor> m_baseFile;
 public:
     std::shared_ptr<VM> m_vm;
 
+    // Only valid inside a ScopedVMMapSession.
+    std::shared_ptr<CacheSession> Session() const { return m_session; };
+
+    // Legacy JSON form; only Load is still used, to read databases saved before the binary state existed.
     void Store() override {
         MSS(m_viewState);
-        MSS(m_rawViewCursor);
         rapidjson::Value loadedImages(rapidjson::kArrayType);
         for (auto img : m_loadedImages)
         {
@@ -208,7 +138,6 @@ public:
     }
     void Load() override {
         m_viewState = loadViewState("m_viewState");
-        MSL(m_rawViewCursor);
         for (auto &imgV: m_activeDeserContext->doc["loadedImages"].GetArray())
         {
             if (imgV.HasMember("name"))
@@ -218,6 +147,10 @@ public:
                 {
                     LoadedImage img;
                     img.LoadFromValue(imgV);
+                    // Offsets here are into the old cursor-allocated raw view; DSCView::Init moves the segments.
+                    for (auto& [offset, range] : img.loadedSegments)
+                        offset = range.first;
+                    m_loadOrder.push_back(name->value.GetString());
                     m_loadedImages[name->value.GetString()] = img;
                 }
             }
@@ -226,51 +159,93 @@ public:
 
 private:
     std::shared_ptr<VMReader> m_vmReader;
-    bool SetupVMMap(bool mapPages = true);
+    bool SetupVMMap();
     bool TeardownVMMap();
     /* VM READER END */
 
     /* CACHE FORMAT START */
-    enum SharedCacheFormat {
-        RegularCacheFormat,
-        SplitCacheFormat,
-        LargeCacheFormat,
-        iOS16CacheFormat,
-    };
     SharedCacheFormat GetCacheFormat();
     /* CACHE FORMAT END */
 
-    std::string Serialize();
+    const CacheImage* ImageForName(const std::string& name);
+    // Waits for the session's symbol index without holding m_mutex, so other API calls aren't stuck behind the build.
+    std::shared_ptr<SymbolIndex> WaitForSymbolIndex();
+    /*
+     * Adds the image's segments to the view. In lazy mode (the "loader.dsc.segmentLoading" load setting)
+     *  __LINKEDIT is only exposed as windows over the data this image's load commands reference.
+     */
+    bool LazySegmentLoading();
+    struct SegmentMapping {
+        uint64_t address;
+        uint64_t size;
+        uint32_t flags;
+        bool prefetch;
+    };
+    // What MapImageSegments would add for the image, without touching the view.
+    std::vector<SegmentMapping> ImageSegmentMappings(const CacheImage& cacheImage, bool lazy);
+    void MapImageSegments(const CacheImage& cacheImage, bool lazy, LoadedImage& image);
+    // Removes the segments MapImageSegments added for `image`, for backing out of a failed load.
+    void UnmapImageSegments(const LoadedImage& image);
+
+    bool LoadBinaryState(BinaryNinja::Ref<BinaryNinja::BinaryView> view);
     void DeserializeFromRawView();
 
 public:
-    static SharedCache* GetFromDSCView(BinaryNinja::Ref<BinaryNinja::BinaryView> dscView);
-    bool SaveToDSCView()
-    {
-        if (m_dscView)
-        {
-            auto data = AsMetadata();
-            m_dscView->StoreMetadata(SharedCacheMetadataTag, data);
-            m_dscView->GetParentView()->GetParentView()->StoreMetadata(SharedCacheMetadataTag, data);
-            BNLogInfo("meta: %s", m_dscView->GetStringMetadata(SharedCacheMetadataTag).c_str());
-            return true;
-        }
-        return false;
-    }
+    /*
+     * The controller of the DSCView `dscView` belongs to. Views register themselves on Init and drop their
+     *  controller when they're destroyed; anything else gets a fresh, unshared controller.
+     */
+    static std::shared_ptr<SharedCache> GetFromDSCView(BinaryNinja::Ref<BinaryNinja::BinaryView> dscView);
+    // Same, for a handle passed in through the C API. Doesn't allocate if the view is registered.
+    static std::shared_ptr<SharedCache> GetFromHandle(BNBinaryView* view);
+    static void RegisterView(BinaryNinja::BinaryView* dscView);
+    static void UnregisterView(BinaryNinja::BinaryView* dscView);
+
+    /*
+     * Writes the view state, plus a record for each image loaded since the last save, to the DSCView's metadata.
+     * Earlier image records are left alone, so this costs the same no matter how many images are loaded.
+     */
+    bool SaveToDSCView();
 
     uint64_t GetImageStart(std::string installName);
     bool LoadImageWithInstallName(std::string installName);
+    /*
+     * Loads every named image (and, up to `dependencyDepth` levels deep, the images they link against)
+     *  in one batch: one undo action, one metadata save, one analysis update.
+     * Returns the number of images newly loaded.
+     */
+    size_t LoadImages(std::vector<std::string> installNames, size_t dependencyDepth = 0);
     bool LoadSectionAtAddress(uint64_t address);
     std::vector<std::string> GetAvailableImages();
 
-    std::vector<LoadedImage> LoadedImages() const {
+    /*
+     * Lookups against the cache's prebuilt ObjC tables; these work whether or not the owning image is loaded.
+     */
+    uint64_t GetObjCSelectorAddress(const std::string& name);
+    // (install name, class address) of every class with this name. Usually one, more if several images define it.
+    std::vector<std::pair<std::string, uint64_t>> GetObjCClassLocations(const std::string& name);
+
+    /*
+     * Lookups against the cache-wide symbol index (exports and local symbols of every image, loaded or not).
+     *
+     * `name` may be qualified with an image, as "libfoo.dylib!_bar"; otherwise the first image defining it wins.
+     * SymbolizeAddress gives "libfoo.dylib!_bar+0x14", or "libfoo.dylib+0x1234" if nothing in the image precedes it.
+     */
+    uint64_t GetSymbolAddress(const std::string& name);
+    std::string SymbolizeAddress(uint64_t address);
+
+    std::vector<LoadedImage> LoadedImages() {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
         std::vector<LoadedImage> imgs;
         for (const auto& [k, v] : m_loadedImages)
             imgs.push_back(v);
         return imgs;
     }
 
-    explicit SharedCache(BinaryNinja::Ref<BinaryNinja::BinaryView> rawView);
+    // Doesn't take the lock, so a UI refresh can poll it while images load.
+    size_t LoadedImageCount() const { return m_loadedImageCount; };
+
+    explicit SharedCache(BinaryNinja::BinaryView* dscView);
 };
 class MachOLoader {
 
@@ -284,10 +259,10 @@ class ScopedVMMapSession
 {
 public:
     ScopedVMMapSession(
-            SharedCache* cache, bool mapPages = true) :
-            m_cache(cache)
+            SharedCache* cache) :
+            m_cache(cache), m_lock(cache->m_mutex)
     {
-        m_cache->SetupVMMap(mapPages);
+        m_cache->SetupVMMap();
     };
     ~ScopedVMMapSession()
     {
@@ -296,6 +271,22 @@ public:
 
 private:
     SharedCache* m_cache;
+    std::unique_lock<std::recursive_mutex> m_lock;
+};
+
+// Commits an undo group on every way out, so a failure part way through a load never leaves it open.
+class ScopedUndoActions
+{
+public:
+    ScopedUndoActions(BinaryNinja::BinaryView* view) : m_view(view), m_id(view->BeginUndoActions()) {};
+    ~ScopedUndoActions()
+    {
+        m_view->CommitUndoActions(m_id);
+    }
+
+private:
+    BinaryNinja::BinaryView* m_view;
+    std::string m_id;
 };
 
 void InitDSCViewType();